@@ -30,6 +30,7 @@
 #include <nds.h>
 #include <maxmod7.h>
 #include <stdlib.h>
+#include "sid7.h"
 
 //---------------------------------------------------------------------------------
 void VcountHandler() {
@@ -78,6 +79,8 @@ int main(int argc, char ** argv) {
 
 	installSystemFIFO();
 
+	sid7_init();
+
 	/* 
 	REG_IPC_FIFO_CR = IPC_FIFO_ENABLE | IPC_FIFO_SEND_CLEAR | IPC_FIFO_RECV_IRQ;
 	irqSet(IRQ_FIFO_NOT_EMPTY, FiFoHandler);
@@ -93,12 +96,15 @@ int main(int argc, char ** argv) {
 
 	setPowerButtonCB(powerButtonCB);
 
-	// Keep the ARM7 mostly idle
+	// Keep the ARM7 mostly idle - unless the SID has been handed to us
 	while (!exitflag) {
 		if ( 0 == (REG_KEYINPUT & (KEY_SELECT | KEY_START | KEY_L | KEY_R))) {
 			exitflag = true;
 		}
-		swiWaitForVBlank();
+		swiIntrWait(1, IRQ_VBLANK | IRQ_TIMER3);
+		if (sid7_pending()) {
+			sid7_render();
+		}
 	}
 	return 0;
 }
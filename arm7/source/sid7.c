@@ -0,0 +1,511 @@
+/*---------------------------------------------------------------------------------
+
+	sid7.c - SID voice, envelope and filter rendering on the ARM7
+
+	GimliDS Copyright (c) 2025-2026 Dave Bernazzani (wavemotion-dave)
+
+	This is the digital renderer from the ARM9 side (SID.cpp - originally
+	from Frodo by Christian Bauer) cut down to what the ARM7 needs. The ARM9
+	streams the SID register writes over the FIFO stamped with the raster
+	line they happened on, we replay them at the matching sample and feed
+	a looping hardware sound channel double-buffered off a timer interrupt.
+
+	See common/SIDFifo.h for the message format.
+
+---------------------------------------------------------------------------------*/
+#include <nds.h>
+#include <string.h>
+#include "SIDFifo.h"
+#include "sid7.h"
+
+#define SID_FREQ            985248
+#define SID_CYCLES_FIX      ((((u32)SID_FREQ << 11) / SID7_SAMPLE_FREQ) << 5)   // SID clocks per sample * 65536
+#define LINE_STEP           (((SID7_LINES_PER_FRAME * SID7_FRAMES_PER_SEC) << 16) / SID7_SAMPLE_FREQ)
+
+#define HALF_BUF            256                             // Samples rendered per timer interrupt
+#define QUEUE_SIZE          1024                            // Must be a power of 2
+#define LATENCY_LINES       SID7_LINES_PER_FRAME            // Output trails the ARM9 by a frame to absorb its bursts
+#define MAX_LEAD_LINES      (SID7_LINES_PER_FRAME * 3)      // Further ahead than this (warp) and we jump forward
+
+// SID waveforms (some of them :-)
+enum {
+	WAVE_NONE,
+	WAVE_TRI,
+	WAVE_SAW,
+	WAVE_TRISAW,
+	WAVE_RECT,
+	WAVE_TRIRECT,
+	WAVE_SAWRECT,
+	WAVE_TRISAWRECT,
+	WAVE_NOISE
+};
+
+// Filter types
+enum {
+	FILT_NONE,
+	FILT_LP,
+	FILT_BP,
+	FILT_LPBP,
+	FILT_HP,
+	FILT_NOTCH,
+	FILT_HPBP,
+	FILT_ALL
+};
+
+// EG states
+enum {
+	EG_ATTACK,
+	EG_DECAY_SUSTAIN,
+	EG_RELEASE
+};
+
+typedef struct {
+	int wave;
+	int eg_state;
+	int mod_by;
+	int mod_to;
+	u32 count;
+	u32 add;
+	u16 freq;
+	u16 pw;
+	s32 a_add;
+	s32 d_sub;
+	s32 s_level;
+	s32 r_sub;
+	s32 eg_level;
+	u32 noise;
+	bool gate;
+	bool ring;
+	bool test;
+	bool sync;
+	bool mute;
+} SID7Voice;
+
+static const s32 EGTable[16] = {
+	SID_CYCLES_FIX / 9,     SID_CYCLES_FIX / 32,
+	SID_CYCLES_FIX / 63,    SID_CYCLES_FIX / 95,
+	SID_CYCLES_FIX / 149,   SID_CYCLES_FIX / 220,
+	SID_CYCLES_FIX / 267,   SID_CYCLES_FIX / 313,
+	SID_CYCLES_FIX / 392,   SID_CYCLES_FIX / 977,
+	SID_CYCLES_FIX / 1954,  SID_CYCLES_FIX / 3126,
+	SID_CYCLES_FIX / 3906,  SID_CYCLES_FIX / 11720,
+	SID_CYCLES_FIX / 19531, SID_CYCLES_FIX / 31251
+};
+
+static const u8 EGDRShift[256] = {
+	5,5,5,5,5,5,5,5,4,4,4,4,4,4,4,4,
+	3,3,3,3,3,3,3,3,3,3,3,3,2,2,2,2,
+	2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+	2,2,2,2,2,2,2,2,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
+};
+
+static SID7Voice voice[3];
+static u16 wave_tables[SID7_WAVE_TABLE_SIZE];       // TriSaw, TriRect, SawRect, TriSawRect
+static s16 sid7_buffer[HALF_BUF * 2];               // Looped by the hardware channel
+
+static volatile u32 queue[QUEUE_SIZE];              // Messages from the ARM9
+static volatile u16 queue_head;                     // Written by the FIFO handler
+static u16 queue_tail;                              // Read by sid7_render()
+
+static volatile bool running;
+static volatile bool paused;
+static volatile bool pending;                       // A half buffer is waiting to be filled
+static int fill_half;
+
+static u8  volume;
+static u8  res_filt;
+static u8  f_type;
+static s32 f_ampl, d1, d2, g1, g2;
+static u16 f_ampl_lo;
+static s32 xn1, xn2, yn1, yn2;
+static u32 random_seed;
+static s16 last_sample;
+
+static bool synced;                                 // Seen a frame marker since start/reset
+static u32 cur_frame;                               // Frame of the last frame marker replayed
+static u32 play_line;                               // Raster line the output is at
+static u32 play_frac;                               // ...and the fraction of it (16 bits)
+
+//---------------------------------------------------------------------------------
+static inline s32 fixmul(s32 x, s32 y) {
+//---------------------------------------------------------------------------------
+	return (s32)(((s64)x * y) >> 16);
+}
+
+//---------------------------------------------------------------------------------
+static inline u8 sid_random(void) {
+//---------------------------------------------------------------------------------
+	random_seed = random_seed * 1103515245 + 12345;
+	return random_seed >> 16;
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_reset(void) {
+//---------------------------------------------------------------------------------
+	int v;
+
+	for (v=0; v<3; v++) {
+		memset(&voice[v], 0, sizeof(SID7Voice));
+		voice[v].wave = WAVE_NONE;
+		voice[v].eg_state = EG_RELEASE;
+		voice[v].count = 0x555555;
+		voice[v].a_add = voice[v].d_sub = voice[v].r_sub = EGTable[0];
+	}
+	voice[0].mod_by = 2; voice[1].mod_by = 0; voice[2].mod_by = 1;
+	voice[0].mod_to = 1; voice[1].mod_to = 2; voice[2].mod_to = 0;
+
+	volume = res_filt = 0;
+	f_type = FILT_NONE;
+	f_ampl = 1 << 16;
+	d1 = d2 = g1 = g2 = 0;
+	xn1 = xn2 = yn1 = yn2 = 0;
+	random_seed = 1;
+	synced = false;
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_write(int adr, u16 data) {
+//---------------------------------------------------------------------------------
+	int v = adr / 7;
+	u8 byte = data & 0xff;
+
+	switch (adr) {
+		case 0: case 7: case 14:
+			voice[v].freq = (voice[v].freq & 0xff00) | byte;
+			voice[v].add = ((u64)SID_CYCLES_FIX * voice[v].freq) >> 16;
+			break;
+
+		case 1: case 8: case 15:
+			voice[v].freq = (voice[v].freq & 0xff) | (byte << 8);
+			voice[v].add = ((u64)SID_CYCLES_FIX * voice[v].freq) >> 16;
+			break;
+
+		case 2: case 9: case 16:
+			voice[v].pw = (voice[v].pw & 0x0f00) | byte;
+			break;
+
+		case 3: case 10: case 17:
+			voice[v].pw = (voice[v].pw & 0xff) | ((byte & 0xf) << 8);
+			break;
+
+		case 4: case 11: case 18:
+			voice[v].wave = (byte >> 4) & 0xf;
+			if ((byte & 1) != voice[v].gate) {
+				voice[v].eg_state = (byte & 1) ? EG_ATTACK : EG_RELEASE;
+			}
+			voice[v].gate = byte & 1;
+			voice[voice[v].mod_by].sync = byte & 2;
+			voice[v].ring = byte & 4;
+			if ((voice[v].test = byte & 8) != 0)
+				voice[v].count = 0;
+			break;
+
+		case 5: case 12: case 19:
+			voice[v].a_add = EGTable[byte >> 4];
+			voice[v].d_sub = EGTable[byte & 0xf];
+			break;
+
+		case 6: case 13: case 20:
+			voice[v].s_level = (byte >> 4) * 0x111111;
+			voice[v].r_sub = EGTable[byte & 0xf];
+			break;
+
+		case 23:
+			res_filt = byte;
+			break;
+
+		case 24:
+			volume = byte & 0xf;
+			voice[2].mute = byte & 0x80;
+			if (((byte >> 4) & 7) != f_type) {
+				f_type = (byte >> 4) & 7;
+				xn1 = xn2 = yn1 = yn2 = 0;
+			}
+			break;
+
+		case SID7_REG_AMPL_LO:  f_ampl_lo = data;                       break;
+		case SID7_REG_AMPL_HI:  f_ampl = (s32)(((u32)data << 16) | f_ampl_lo); break;
+		case SID7_REG_D1:       d1 = (s16)data * 8;                     break;
+		case SID7_REG_D2:       d2 = (s16)data * 8;                     break;
+		case SID7_REG_G1:       g1 = (s16)data * 4;                     break;
+		case SID7_REG_G2:       g2 = (s16)data * 4;                     break;
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Replay every queued message that is due at the current output position
+//---------------------------------------------------------------------------------
+static void sid7_replay(void) {
+//---------------------------------------------------------------------------------
+	while (queue_tail != queue_head) {
+		u32 msg = queue[queue_tail];
+
+		if (msg & SID7_MSG_CMD) {
+			// Only frame markers are queued - everything else is handled on arrival
+			u32 frame = synced ? cur_frame + (u16)(SID7_MSG_ARG(msg) - cur_frame) : SID7_MSG_ARG(msg);
+			u32 t = frame * SID7_LINES_PER_FRAME;
+			s32 lead = (s32)(t - play_line);
+
+			// First marker, or the ARM9 has drifted too far (warp, pause) - line back up
+			if (!synced || lead > MAX_LEAD_LINES || lead < -LATENCY_LINES) {
+				play_line = t - LATENCY_LINES;
+				synced = true;
+			}
+			else if (lead > 0) {
+				break;
+			}
+			cur_frame = frame;
+		}
+		else if (synced && (s32)(cur_frame * SID7_LINES_PER_FRAME + SID7_MSG_LINE(msg) - play_line) > 0) {
+			break;
+		}
+		else {
+			sid7_write(SID7_MSG_REGNUM(msg), SID7_MSG_DATA(msg));
+		}
+		queue_tail = (queue_tail + 1) & (QUEUE_SIZE - 1);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Fill the half of the output buffer the channel has just finished playing
+//---------------------------------------------------------------------------------
+void sid7_render(void) {
+//---------------------------------------------------------------------------------
+	s16 *buf = &sid7_buffer[fill_half * HALF_BUF];
+	int count = HALF_BUF;
+	int j;
+
+	pending = false;
+	fill_half ^= 1;
+
+	if (paused) {
+		while (count--) *buf++ = last_sample;
+		return;
+	}
+
+	while (count--) {
+		s32 sum_output = 0;
+		s32 sum_output_filter = 0;
+		s32 xn, yn, ext_output;
+
+		sid7_replay();
+
+		play_frac += LINE_STEP;
+		play_line += play_frac >> 16;
+		play_frac &= 0xffff;
+
+		for (j=0; j<3; j++) {
+			SID7Voice *v = &voice[j];
+			u16 envelope;
+			u16 output;
+
+			// Envelope generator
+			switch (v->eg_state) {
+				case EG_ATTACK:
+					v->eg_level += v->a_add;
+					if (v->eg_level > 0xffffff) {
+						v->eg_level = 0xffffff;
+						v->eg_state = EG_DECAY_SUSTAIN;
+					}
+					break;
+				case EG_DECAY_SUSTAIN:
+					v->eg_level -= v->d_sub >> EGDRShift[v->eg_level >> 16];
+					if (v->eg_level < v->s_level) {
+						v->eg_level = v->s_level;
+					}
+					break;
+				case EG_RELEASE:
+					v->eg_level -= v->r_sub >> EGDRShift[v->eg_level >> 16];
+					if (v->eg_level < 0) {
+						v->eg_level = 0;
+					}
+					break;
+			}
+			envelope = v->eg_level >> 16;
+
+			// Waveform generator
+			if (v->mute)
+				continue;
+
+			if (!v->test)
+				v->count += v->add;
+
+			if (v->sync && (v->count > 0x1000000))
+				voice[v->mod_to].count = 0;
+
+			v->count &= 0xffffff;
+
+			switch (v->wave) {
+				case WAVE_TRI: {
+						u32 ctrl = v->count;
+						if (v->ring) ctrl ^= voice[v->mod_by].count;
+						output = (ctrl & 0x800000) ? (v->count >> 7) ^ 0xffff : v->count >> 7;
+					}
+					break;
+				case WAVE_SAW:
+					output = v->count >> 8;
+					break;
+				case WAVE_RECT:
+					output = (v->test || v->count >= (u32)(v->pw << 12)) ? 0xffff : 0;
+					break;
+				case WAVE_TRISAW:
+					output = wave_tables[0x000 + (v->count >> 16)];
+					break;
+				case WAVE_TRIRECT:
+					if (v->test || v->count >= (u32)(v->pw << 12)) {
+						u32 ctrl = v->count;
+						if (v->ring) ctrl ^= ~(voice[v->mod_by].count) & 0x800000;
+						output = wave_tables[0x100 + (ctrl >> 16)];
+					} else {
+						output = 0;
+					}
+					break;
+				case WAVE_SAWRECT:
+					output = (v->test || v->count >= (u32)(v->pw << 12)) ? wave_tables[0x200 + (v->count >> 16)] : 0;
+					break;
+				case WAVE_TRISAWRECT:
+					output = (v->test || v->count >= (u32)(v->pw << 12)) ? wave_tables[0x300 + (v->count >> 16)] : 0;
+					break;
+				case WAVE_NOISE:
+					if (v->count > 0x100000) {
+						output = v->noise = sid_random() << 8;
+						v->count &= 0xfffff;
+					} else {
+						output = v->noise;
+					}
+					break;
+				default:
+					output = 0x8000;
+					break;
+			}
+
+			// Route voice through filter if selected
+			if (res_filt & (1 << j))
+				sum_output_filter += (s16)(output ^ 0x8000) * envelope;
+			else
+				sum_output += (s16)(output ^ 0x8000) * envelope;
+		}
+
+		// Filter
+		xn = fixmul(f_ampl, sum_output_filter);
+		yn = xn + fixmul(d1, xn1) + fixmul(d2, xn2) - fixmul(g1, yn1) - fixmul(g2, yn2);
+		yn2 = yn1; yn1 = yn; xn2 = xn1; xn1 = xn;
+
+		ext_output = ((sum_output - yn + 0x100000) * volume) >> 13;
+
+		if (ext_output > 0x7fff) ext_output = 0x7fff;
+		else if (ext_output < -0x8000) ext_output = -0x8000;
+
+		*buf++ = ext_output;
+	}
+	last_sample = buf[-1];
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_timer(void) {
+//---------------------------------------------------------------------------------
+	pending = true;
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_start(void) {
+//---------------------------------------------------------------------------------
+	if (running) return;
+
+	sid7_reset();
+	memset(sid7_buffer, 0, sizeof(sid7_buffer));
+	queue_tail = queue_head;
+	fill_half = 0;
+	pending = false;
+	paused = false;
+	last_sample = 0;
+
+	SCHANNEL_CR(SID7_CHANNEL) = 0;
+	SCHANNEL_SOURCE(SID7_CHANNEL) = (u32)sid7_buffer;
+	SCHANNEL_REPEAT_POINT(SID7_CHANNEL) = 0;
+	SCHANNEL_LENGTH(SID7_CHANNEL) = sizeof(sid7_buffer) >> 2;
+	SCHANNEL_TIMER(SID7_CHANNEL) = SOUND_FREQ(SID7_SAMPLE_FREQ);
+
+	// Timer 2 ticks once per sample (it runs off the bus clock - twice the sound clock)
+	// and timer 3 counts off a half buffer's worth of samples.
+	TIMER_DATA(2) = (u16)(SOUND_FREQ(SID7_SAMPLE_FREQ) * 2);
+	TIMER_DATA(3) = 65536 - HALF_BUF;
+	irqSet(IRQ_TIMER3, sid7_timer);
+	irqEnable(IRQ_TIMER3);
+
+	TIMER_CR(3) = TIMER_ENABLE | TIMER_CASCADE | TIMER_IRQ_REQ;
+	TIMER_CR(2) = TIMER_ENABLE | TIMER_DIV_1;
+	SCHANNEL_CR(SID7_CHANNEL) = SCHANNEL_ENABLE | SOUND_REPEAT | SOUND_VOL(127) | SOUND_PAN(64) | SOUND_FORMAT_16BIT;
+
+	running = true;
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_stop(void) {
+//---------------------------------------------------------------------------------
+	SCHANNEL_CR(SID7_CHANNEL) = 0;
+	TIMER_CR(2) = 0;
+	TIMER_CR(3) = 0;
+	irqDisable(IRQ_TIMER3);
+	running = false;
+	pending = false;
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_value_handler(u32 msg, void *userdata) {
+//---------------------------------------------------------------------------------
+	if (msg & SID7_MSG_CMD) {
+		switch (SID7_MSG_CMDNUM(msg)) {
+			case SID7_CMD_START:  sid7_start();                        return;
+			case SID7_CMD_STOP:   sid7_stop();                         return;
+			case SID7_CMD_RESET:  queue_tail = queue_head; sid7_reset(); return;
+			case SID7_CMD_PAUSE:  paused = true;                       return;
+			case SID7_CMD_RESUME: paused = false;                      return;
+			case SID7_CMD_FRAME:  break;    // Queued with the register writes
+			default:                                                   return;
+		}
+	}
+
+	if (!running) return;
+
+	u16 next = (queue_head + 1) & (QUEUE_SIZE - 1);
+	if (next != queue_tail) {       // If we're full the write is dropped
+		queue[queue_head] = msg;
+		queue_head = next;
+	}
+}
+
+//---------------------------------------------------------------------------------
+static void sid7_address_handler(void *address, void *userdata) {
+//---------------------------------------------------------------------------------
+	memcpy(wave_tables, address, sizeof(wave_tables));
+}
+
+//---------------------------------------------------------------------------------
+void sid7_init(void) {
+//---------------------------------------------------------------------------------
+	running = false;
+	queue_head = queue_tail = 0;
+	sid7_reset();
+
+	fifoSetValue32Handler(FIFO_SID7, sid7_value_handler, 0);
+	fifoSetAddressHandler(FIFO_SID7, sid7_address_handler, 0);
+}
+
+//---------------------------------------------------------------------------------
+bool sid7_pending(void) {
+//---------------------------------------------------------------------------------
+	return pending;
+}
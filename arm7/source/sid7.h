@@ -0,0 +1,13 @@
+/*---------------------------------------------------------------------------------
+
+	sid7.h - SID rendering on the ARM7 (see sid7.c)
+
+---------------------------------------------------------------------------------*/
+#ifndef _SID7_H
+#define _SID7_H
+
+void sid7_init(void);
+void sid7_render(void);
+bool sid7_pending(void);
+
+#endif
@@ -105,6 +105,8 @@ const int accum_num_sectors[41] = {
 
 // Prototypes
 static bool match(const uint8 *p, int p_len, const uint8 *n);
+static void clear_sector_cache(sector_cache *cache);
+static void flush_sector_cache(FILE *f, const image_file_desc &desc, sector_cache *cache);
 static FILE *open_image_file(const char *path, bool write_mode);
 static bool parse_image_file(FILE *f, image_file_desc &desc);
 
@@ -113,7 +115,7 @@ static bool parse_image_file(FILE *f, image_file_desc &desc);
  *  Constructor: Prepare emulation, open image file
  */
 
-ImageDrive::ImageDrive(IEC *iec, const char *filepath) : Drive(iec), the_file(NULL), bam(ram + 0x700), bam_dirty(false)
+ImageDrive::ImageDrive(IEC *iec, const char *filepath) : Drive(iec), the_file(NULL), cache(new sector_cache), dir_index_count(-1), bam(ram + 0x700), bam_dirty(false)
 {
     for (int i=0; i<18; i++) {
         ch[i].mode = CHMOD_FREE;
@@ -136,6 +138,7 @@ ImageDrive::ImageDrive(IEC *iec, const char *filepath) : Drive(iec), the_file(NU
 ImageDrive::~ImageDrive()
 {
     close_image();
+    delete cache;
 }
 
 
@@ -147,10 +150,7 @@ void ImageDrive::close_image(void)
 {
     if (the_file) {
         close_all_channels();
-        if (bam_dirty) {
-            write_sector(DIR_TRACK, 0, bam);
-            bam_dirty = false;
-        }
+        Flush();
         fclose(the_file);
         the_file = NULL;
     }
@@ -165,6 +165,8 @@ bool ImageDrive::change_image(const char *path)
 {
     // Close old image file
     close_image();
+    clear_sector_cache(cache);
+    dir_index_count = -1;
 
     // Open new image file (try write access first, then read-only)
     write_protected = false;
@@ -499,77 +501,69 @@ uint8 ImageDrive::open_directory(const uint8 *pattern, int pattern_len)
     *(p-7) = '\"';
     *p++ = 0;
 
-    // Scan all directory blocks
-    dir[DIR_NEXT_TRACK] = DIR_TRACK;
-    dir[DIR_NEXT_SECTOR] = 1;
-
-    int num_dir_blocks = 0;
-    while (dir[DIR_NEXT_TRACK] && num_dir_blocks < num_sectors[DIR_TRACK]) {
-        if (!read_sector(dir[DIR_NEXT_TRACK], dir[DIR_NEXT_SECTOR], dir))
-            return ST_OK;
-        num_dir_blocks++;
-
-        // Scan all 8 entries of a block
-        uint8 *de = dir + DIR_ENTRIES;
-        for (int j=0; j<8; j++, de+=SIZEOF_DE) {
-            if (de[DE_TYPE] && (pattern_len == 0 || match(pattern, pattern_len, de + DE_NAME))) {
-
-                // Dummy line link
-                *p++ = 0x01;
-                *p++ = 0x01;
-
-                // Line number = number of blocks
-                *p++ = de[DE_NUM_BLOCKS_L];
-                *p++ = de[DE_NUM_BLOCKS_H];
-
-                // Appropriate number of spaces to align file names
+    // List all directory entries
+    if (dir_index_count < 0)
+        build_dir_index();
+
+    for (int j=0; j<dir_index_count; j++) {
+        uint8 *de = dir_index[j].de;
+        if (pattern_len == 0 || match(pattern, pattern_len, de + DE_NAME)) {
+
+            // Dummy line link
+            *p++ = 0x01;
+            *p++ = 0x01;
+
+            // Line number = number of blocks
+            *p++ = de[DE_NUM_BLOCKS_L];
+            *p++ = de[DE_NUM_BLOCKS_H];
+
+            // Appropriate number of spaces to align file names
+            *p++ = ' ';
+            int n = (de[DE_NUM_BLOCKS_H] << 8) + de[DE_NUM_BLOCKS_L];
+            if (n<10) *p++ = ' ';
+            if (n<100) *p++ = ' ';
+
+            // File name enclosed in quotes
+            *p++ = '\"';
+            q = de + DE_NAME;
+            uint8 c;
+            bool m = false;
+            for (int i=0; i<16; i++) {
+                if ((c = *q++) == 0xa0) {
+                    if (m)
+                        *p++ = ' ';         // Replace all 0xa0 by spaces
+                    else
+                        m = (*p++ = '\"');  // But the first by a '"'
+                } else
+                    *p++ = c;
+            }
+            if (m)
                 *p++ = ' ';
-                int n = (de[DE_NUM_BLOCKS_H] << 8) + de[DE_NUM_BLOCKS_L];
-                if (n<10) *p++ = ' ';
-                if (n<100) *p++ = ' ';
-
-                // File name enclosed in quotes
-                *p++ = '\"';
-                q = de + DE_NAME;
-                uint8 c;
-                bool m = false;
-                for (int i=0; i<16; i++) {
-                    if ((c = *q++) == 0xa0) {
-                        if (m)
-                            *p++ = ' ';         // Replace all 0xa0 by spaces
-                        else
-                            m = (*p++ = '\"');  // But the first by a '"'
-                    } else
-                        *p++ = c;
-                }
-                if (m)
-                    *p++ = ' ';
-                else
-                    *p++ = '\"';            // No 0xa0, then append a space
-
-                // Open files are marked by '*'
-                if (de[DE_TYPE] & 0x80)
-                    *p++ = ' ';
-                else
-                    *p++ = '*';
+            else
+                *p++ = '\"';            // No 0xa0, then append a space
 
-                // File type
-                *p++ = type_char_1[de[DE_TYPE] & 7];
-                *p++ = type_char_2[de[DE_TYPE] & 7];
-                *p++ = type_char_3[de[DE_TYPE] & 7];
+            // Open files are marked by '*'
+            if (de[DE_TYPE] & 0x80)
+                *p++ = ' ';
+            else
+                *p++ = '*';
 
-                // Protected files are marked by '<'
-                if (de[DE_TYPE] & 0x40)
-                    *p++ = '<';
-                else
-                    *p++ = ' ';
+            // File type
+            *p++ = type_char_1[de[DE_TYPE] & 7];
+            *p++ = type_char_2[de[DE_TYPE] & 7];
+            *p++ = type_char_3[de[DE_TYPE] & 7];
 
-                // Appropriate number of spaces at the end
+            // Protected files are marked by '<'
+            if (de[DE_TYPE] & 0x40)
+                *p++ = '<';
+            else
                 *p++ = ' ';
-                if (n >= 10) *p++ = ' ';
-                if (n >= 100) *p++ = ' ';
-                *p++ = 0;
-            }
+
+            // Appropriate number of spaces at the end
+            *p++ = ' ';
+            if (n >= 10) *p++ = ' ';
+            if (n >= 100) *p++ = ' ';
+            *p++ = 0;
         }
     }
 
@@ -709,10 +703,93 @@ free:       free_buffer(ch[channel].buf_num);
             break;
     }
 
+    // Data blocks, directory and BAM of a file written on this channel go out together
+    Flush();
     return ST_OK;
 }
 
 
+/*
+ *  Write back the BAM and all sectors held by the write-behind cache
+ */
+
+void ImageDrive::Flush(void)
+{
+    if (bam_dirty) {
+        write_sector(DIR_TRACK, 0, bam);
+        bam_dirty = false;
+    }
+    flush_sector_cache(the_file, desc, cache);
+}
+
+
+/*
+ *  Copy a whole PRG file straight into C64 RAM (kernal LOAD trap).
+ *  Directory listings, direct access and anything the drive would
+ *  complain about are left to the regular IEC transfer.
+ */
+
+bool ImageDrive::Load(const uint8 *name, int name_len, uint8 *ram, bool file_adr, uint16 &start, uint16 &end)
+{
+    if (name[0] == '$' || name[0] == '#' || name[0] == '@')
+        return false;
+
+    uint8 plain_name[NAMEBUF_LENGTH];
+    int plain_name_len;
+    int mode = FMODE_READ;
+    int type = FTYPE_DEL;
+    int rec_len = 0;
+    parse_file_name(name, name_len, plain_name, plain_name_len, mode, type, rec_len);
+    if (plain_name_len > 16)
+        plain_name_len = 16;
+    if (mode != FMODE_READ || (type != FTYPE_DEL && type != FTYPE_PRG))
+        return false;
+
+    int dir_track, dir_sector, entry;
+    if (!find_first_file(plain_name, plain_name_len, dir_track, dir_sector, entry))
+        return false;   // Let the kernal report FILE NOT FOUND
+    uint8 *de = dir + DIR_ENTRIES + entry * SIZEOF_DE;
+    if ((de[DE_TYPE] & 7) != FTYPE_PRG)
+        return false;
+
+    // Follow the block chain, copying the data part of each block
+    uint8 block[256];
+    int track = de[DE_TRACK], sector = de[DE_SECTOR];
+    int adr = -1;
+    for (int num_blocks = 0; track; num_blocks++) {
+        if (num_blocks >= NUM_SECTORS_40 || !read_sector(track, sector, block))
+            return false;
+
+        int len = block[0] ? 254 : block[1] - 1;
+        uint8 *p = block + 2;
+        if (adr < 0) {
+            // First two bytes are the load address
+            if (len < 2)
+                return false;
+            start = file_adr ? (p[0] | (p[1] << 8)) : start;
+            adr = start;
+            p += 2;
+            len -= 2;
+        }
+
+        // Stay clear of the I/O area and the end of memory, the kernal handles those
+        if (len < 0 || (adr < 0xe000 && adr + len > 0xd000) || adr + len > 0xffff)
+            return false;
+        memcpy(ram + adr, p, len);
+        adr += len;
+
+        track = block[0];
+        sector = block[1];
+    }
+    if (adr < 0)
+        return false;
+
+    end = adr;
+    set_error(ERR_OK);
+    return true;
+}
+
+
 /*
  *  Close all channels
  */
@@ -885,10 +962,7 @@ void ImageDrive::Reset(void)
     for (int i=0; i<4; i++)
         buf_free[i] = true;
 
-    if (bam_dirty) {
-        write_sector(DIR_TRACK, 0, bam);
-        bam_dirty = false;
-    }
+    Flush();
 
     memset(ram, 0, sizeof(ram));
 
@@ -959,42 +1033,92 @@ static bool match(const uint8 *p, int p_len, const uint8 *n)
     return *n == 0xa0 || c == 16;
 }
 
-bool ImageDrive::find_file(const uint8 *pattern, int pattern_len, int &dir_track, int &dir_sector, int &entry, bool cont)
+// Hash of a file name (up to the first 0xa0) for the directory index
+static uint8 name_hash(const uint8 *n, int len)
 {
-    // Counter to prevent cyclic directories from resulting in an infinite loop
+    if (len > 16)
+        len = 16;
+
+    uint32 h = 0;
+    while (len-- > 0 && *n != 0xa0)
+        h = h * 31 + *n++;
+    return h & (DIR_HASH_SIZE - 1);
+}
+
+// Index all used directory entries, following the directory chain once
+void ImageDrive::build_dir_index(void)
+{
+    dir_index_count = 0;
+    memset(dir_hash, 0xff, sizeof(dir_hash));
+
+    uint8 blk[256];
+    blk[DIR_NEXT_TRACK] = DIR_TRACK;
+    blk[DIR_NEXT_SECTOR] = 1;
+
     int num_dir_blocks = 0;
+    while (blk[DIR_NEXT_TRACK] && num_dir_blocks < num_sectors[DIR_TRACK]) {
+        int track = blk[DIR_NEXT_TRACK], sector = blk[DIR_NEXT_SECTOR];
+        if (!read_sector(track, sector, blk))
+            break;
 
-    // Pointer to current directory entry
-    uint8 *de = NULL;
-    if (cont)
-        de = dir + DIR_ENTRIES + entry * SIZEOF_DE;
-    else {
-        dir[DIR_NEXT_TRACK] = DIR_TRACK;
-        dir[DIR_NEXT_SECTOR] = 1;
-        entry = 8;
+        uint8 *de = blk + DIR_ENTRIES;
+        for (int j=0; j<8; j++, de+=SIZEOF_DE) {
+            if (de[DE_TYPE] == 0)
+                continue;
+
+            dir_index_entry &e = dir_index[dir_index_count++];
+            memcpy(e.de, de, SIZEOF_DE);
+            e.track = track;
+            e.sector = sector;
+            e.pos = num_dir_blocks * 8 + j;
+        }
+        num_dir_blocks++;
     }
 
-    while (num_dir_blocks < num_sectors[DIR_TRACK]) {
+    // Chain entries by name hash, keeping directory order within a chain
+    for (int i=dir_index_count-1; i>=0; i--) {
+        uint8 h = name_hash(dir_index[i].de + DE_NAME, 16);
+        dir_index[i].next = dir_hash[h];
+        dir_hash[h] = i;
+    }
+}
 
-        // Goto next entry
-        entry++; de += SIZEOF_DE;
-        if (entry >= 8) {
+bool ImageDrive::find_file(const uint8 *pattern, int pattern_len, int &dir_track, int &dir_sector, int &entry, bool cont)
+{
+    if (dir_index_count < 0)
+        build_dir_index();
 
-            // Read next directory block
-            if (dir[DIR_NEXT_TRACK] == 0)
-                return false;
-            if (!read_sector(dir_track = dir[DIR_NEXT_TRACK], dir_sector = dir[DIR_NEXT_SECTOR], dir))
-                return false;
-            num_dir_blocks++;
-            entry = 0;
-            de = dir + DIR_ENTRIES;
-        }
+    // A name without wildcards only needs to look at its hash chain
+    bool wildcards = memchr(pattern, '*', pattern_len) || memchr(pattern, '?', pattern_len);
+    int start = cont ? dir_find_pos + 1 : 0;
 
-        // Does entry match pattern?
-        if ((de[DE_TYPE] & 0x3f) != FTYPE_DEL && match(pattern, pattern_len, de + DE_NAME))
-            return true;
+    const dir_index_entry *found = NULL;
+    if (!wildcards) {
+        for (int i=dir_hash[name_hash(pattern, pattern_len)]; i!=0xff; i=dir_index[i].next) {
+            const dir_index_entry &e = dir_index[i];
+            if (e.pos >= start && (e.de[DE_TYPE] & 0x3f) != FTYPE_DEL && match(pattern, pattern_len, e.de + DE_NAME)) {
+                found = &e;
+                break;
+            }
+        }
+    } else {
+        for (int i=0; i<dir_index_count; i++) {
+            const dir_index_entry &e = dir_index[i];
+            if (e.pos >= start && (e.de[DE_TYPE] & 0x3f) != FTYPE_DEL && match(pattern, pattern_len, e.de + DE_NAME)) {
+                found = &e;
+                break;
+            }
+        }
     }
-    return false;
+    if (found == NULL)
+        return false;
+
+    // Callers work on the entry in the directory block buffer
+    dir_track = found->track;
+    dir_sector = found->sector;
+    entry = found->pos & 7;
+    dir_find_pos = found->pos;
+    return read_sector(dir_track, dir_sector, dir);
 }
 
 bool ImageDrive::find_first_file(const uint8 *pattern, int pattern_len, int &dir_track, int &dir_sector, int &entry)
@@ -1296,8 +1420,47 @@ const int conv_job_error[16] = {
     ERR_NOTREADY        // 15 -> 74 DRIVE NOT READY
 };
 
+// Empty the sector cache
+static void clear_sector_cache(sector_cache *cache)
+{
+    for (int i=0; i<SECTOR_CACHE_SIZE; i++) {
+        cache->ts[i] = -1;
+        cache->used[i] = 0;
+        cache->dirty[i] = false;
+    }
+    cache->clock = 0;
+    cache->num_dirty = 0;
+}
+
+// Find the cache slot holding a sector, -1 if it isn't cached
+static int find_cached_sector(const sector_cache *cache, int track, int sector)
+{
+    int ts = (track << 8) | sector;
+    for (int i=0; i<SECTOR_CACHE_SIZE; i++) {
+        if (cache->ts[i] == ts)
+            return i;
+    }
+    return -1;
+}
+
+// Get a cache slot for a sector - the one already holding it or the least
+// recently used one that isn't waiting to be written
+static int alloc_cached_sector(sector_cache *cache, int track, int sector)
+{
+    int slot = find_cached_sector(cache, track, sector);
+    if (slot < 0) {
+        for (int i=0; i<SECTOR_CACHE_SIZE; i++) {
+            if (!cache->dirty[i] && (slot < 0 || cache->used[i] < cache->used[slot]))
+                slot = i;
+        }
+        cache->ts[slot] = (track << 8) | sector;
+    }
+    cache->used[slot] = ++cache->clock;
+    return slot;
+}
+
 // Read sector, return error code
-static int read_sector(FILE *f, const image_file_desc &desc, int track, int sector, uint8 *buffer)
+static int read_sector(FILE *f, const image_file_desc &desc, int track, int sector, uint8 *buffer, sector_cache *cache = NULL)
 {
     floppy_soundfx(0);   // Play floppy SFX if needed
 
@@ -1309,13 +1472,39 @@ static int read_sector(FILE *f, const image_file_desc &desc, int track, int sect
     if (f == NULL)
         return ERR_NOTREADY;
 
-    fseek(f, offset, SEEK_SET);
-    if (fread(buffer, 1, 256, f) != 256)
-        return ERR_READ22;
-    else {
-        unsigned int error = error_info_for_sector(desc, track, sector);
-        return conv_job_error[error & 0x0f];
+    if (cache) {
+        int slot = find_cached_sector(cache, track, sector);
+        if (slot < 0) {
+
+            // Not cached - one seek, then read the rest of the track as it lies in the file
+            fseek(f, offset, SEEK_SET);
+            for (int s=sector; s<num_sectors[track]; s++) {
+                // Sectors already in the cache are newer than the image (they may be dirty) - leave them be
+                if (find_cached_sector(cache, track, s) >= 0) {
+                    fseek(f, 256, SEEK_CUR);
+                    continue;
+                }
+                int n = alloc_cached_sector(cache, track, s);
+                if (fread(cache->data[n], 1, 256, f) != 256) {
+                    cache->ts[n] = -1;
+                    cache->used[n] = 0;
+                    break;
+                }
+            }
+            slot = find_cached_sector(cache, track, sector);
+            if (slot < 0)
+                return ERR_READ22;
+        }
+        cache->used[slot] = ++cache->clock;
+        memcpy(buffer, cache->data[slot], 256);
+    } else {
+        fseek(f, offset, SEEK_SET);
+        if (fread(buffer, 1, 256, f) != 256)
+            return ERR_READ22;
     }
+
+    unsigned int error = error_info_for_sector(desc, track, sector);
+    return conv_job_error[error & 0x0f];
 }
 
 // Convert to job error code
@@ -1324,8 +1513,40 @@ int get_job_error(int error)
     return conv_job_error[error & 0x0f];
 }
 
+// Write the dirty sectors of the cache to the image file in one batch - file
+// data first, then directory blocks, then the BAM, each in file order. An
+// interrupted flush so never leaves the directory or BAM pointing at blocks
+// that weren't written yet.
+static void flush_sector_cache(FILE *f, const image_file_desc &desc, sector_cache *cache)
+{
+    if (f == NULL || cache->num_dirty == 0)
+        return;
+
+    for (int pass=0; pass<3; pass++) {
+        for (;;) {
+            int slot = -1;
+            for (int i=0; i<SECTOR_CACHE_SIZE; i++) {
+                if (!cache->dirty[i])
+                    continue;
+                int track = cache->ts[i] >> 8, sector = cache->ts[i] & 0xff;
+                int order = (track != DIR_TRACK) ? 0 : (sector != 0) ? 1 : 2;
+                if (order == pass && (slot < 0 || cache->ts[i] < cache->ts[slot]))
+                    slot = i;
+            }
+            if (slot < 0)
+                break;
+
+            fseek(f, offset_from_ts(desc, cache->ts[slot] >> 8, cache->ts[slot] & 0xff), SEEK_SET);
+            fwrite(cache->data[slot], 1, 256, f);
+            cache->dirty[slot] = false;
+            cache->num_dirty--;
+        }
+    }
+    fflush(f);
+}
+
 // Write sector, return error code
-static int write_sector(FILE *f, const image_file_desc &desc, int track, int sector, uint8 *buffer)
+static int write_sector(FILE *f, const image_file_desc &desc, int track, int sector, uint8 *buffer, sector_cache *cache = NULL)
 {
     floppy_soundfx(1);   // Play floppy SFX if needed
 
@@ -1337,6 +1558,23 @@ static int write_sector(FILE *f, const image_file_desc &desc, int track, int sec
     if (f == NULL)
         return ERR_NOTREADY;
 
+    // With a cache the sector is held in RAM until the next flush (write-behind)
+    if (cache) {
+        if (!(myConfig.diskFlash & 0x02))
+            return ERR_WRITE25;
+
+        if (cache->num_dirty >= SECTOR_CACHE_SIZE / 2)
+            flush_sector_cache(f, desc, cache);
+
+        int slot = alloc_cached_sector(cache, track, sector);
+        memcpy(cache->data[slot], buffer, 256);
+        if (!cache->dirty[slot]) {
+            cache->dirty[slot] = true;
+            cache->num_dirty++;
+        }
+        return ERR_OK;
+    }
+
     fseek(f, offset, SEEK_SET);
 
     // Is the disk writable?
@@ -1352,7 +1590,7 @@ static int write_sector(FILE *f, const image_file_desc &desc, int track, int sec
 // Read sector and set error message, returns false on error
 bool ImageDrive::read_sector(int track, int sector, uint8 *buffer)
 {
-    int error = ::read_sector(the_file, desc, track, sector, buffer);
+    int error = ::read_sector(the_file, desc, track, sector, buffer, cache);
     if (error)
         set_error(error, track, sector);
     return error == ERR_OK;
@@ -1361,7 +1599,12 @@ bool ImageDrive::read_sector(int track, int sector, uint8 *buffer)
 // Write sector and set error message, returns false on error
 bool ImageDrive::write_sector(int track, int sector, uint8 *buffer)
 {
-    int error = ::write_sector(the_file, desc, track, sector, buffer);
+    // Anything written to the directory track (new, renamed, scratched or closed
+    // files, directory blocks) makes the directory index stale
+    if (track == DIR_TRACK && sector != 0)
+        dir_index_count = -1;
+
+    int error = ::write_sector(the_file, desc, track, sector, buffer, write_protected ? NULL : cache);
     if (error)
         set_error(error, track, sector);
     return error == ERR_OK;
@@ -1382,10 +1625,13 @@ static void write_back_error_info(FILE *f, const image_file_desc &desc)
 }
 
 // Format disk image
-static bool format_image(FILE *f, image_file_desc &desc, bool lowlevel, uint8 id1, uint8 id2, const uint8 *disk_name, int disk_name_len)
+static bool format_image(FILE *f, image_file_desc &desc, bool lowlevel, uint8 id1, uint8 id2, const uint8 *disk_name, int disk_name_len, sector_cache *cache = NULL)
 {
     uint8 p[256];
 
+    if (cache)
+        clear_sector_cache(cache);
+
     if (lowlevel) {
 
         // Fill buffer with 1541 empty sector pattern (4b 01 01 ...,
@@ -1716,10 +1962,7 @@ void ImageDrive::initialize_cmd(void)
 {
     // Close all channels and re-read BAM
     close_all_channels();
-    if (bam_dirty) {
-        write_sector(DIR_TRACK, 0, bam);
-        bam_dirty = false;
-    }
+    Flush();
     read_sector(DIR_TRACK, 0, bam);
 }
 
@@ -1755,7 +1998,9 @@ void ImageDrive::new_cmd(const uint8 *name, int name_len, const uint8 *comma)
     }
 
     // Format disk image
-    format_image(the_file, desc, comma, id1, id2, name, name_len);
+    Flush();
+    format_image(the_file, desc, comma, id1, id2, name, name_len, cache);
+    dir_index_count = -1;
 
     // Re-read BAM
     read_sector(DIR_TRACK, 0, bam);
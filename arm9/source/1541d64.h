@@ -49,6 +49,9 @@
 // Constants
 const int NUM_SECTORS_35 = 683; // Number of sectors in a 35-track image
 const int NUM_SECTORS_40 = 768; // Number of sectors in a 40-track image
+const int SECTOR_CACHE_SIZE = 64; // Number of sectors kept by the sector cache
+const int DIR_INDEX_SIZE = 19 * 8; // Entries of a full directory (all of track 18)
+const int DIR_HASH_SIZE = 32;   // Number of file name hash chains in the directory index
 
 // Disk image types
 enum {
@@ -82,6 +85,24 @@ struct image_file_desc {
     bool has_error_info;    // Flag: error info present in file
 };
 
+// Cache of recently read sectors of an image file
+struct sector_cache {
+    int ts[SECTOR_CACHE_SIZE];          // Track << 8 | sector held by each slot (-1 = empty)
+    uint32 used[SECTOR_CACHE_SIZE];     // LRU stamp of each slot
+    uint32 clock;                       // Source of the LRU stamps
+    bool dirty[SECTOR_CACHE_SIZE];      // Flags: sector written, not yet in the image file
+    int num_dirty;                      // Number of dirty sectors
+    uint8 data[SECTOR_CACHE_SIZE][256]; // Sector contents
+};
+
+// Directory index entry
+struct dir_index_entry {
+    uint8 de[32];           // Copy of the directory entry
+    uint8 track, sector;    // Directory block holding the entry
+    uint8 pos;              // Position in the directory (block number * 8 + entry)
+    uint8 next;             // Next entry with the same name hash (0xff = none)
+};
+
 // Disk image drive class
 class ImageDrive : public Drive {
 public:
@@ -93,6 +114,8 @@ public:
     virtual uint8 Read(int channel, uint8 &byte);
     virtual uint8 Write(int channel, uint8 byte, bool eoi);
     virtual void Reset(void);
+    virtual void Flush(void);
+    virtual bool Load(const uint8 *name, int name_len, uint8 *ram, bool file_adr, uint16 &start, uint16 &end);
 
 private:
     void close_image(void);
@@ -111,6 +134,7 @@ private:
     bool find_file(const uint8 *pattern, int pattern_len, int &dir_track, int &dir_sector, int &entry, bool cont);
     bool find_first_file(const uint8 *pattern, int pattern_len, int &dir_track, int &dir_sector, int &entry);
     bool find_next_file(const uint8 *pattern, int pattern_len, int &dir_track, int &dir_sector, int &entry);
+    void build_dir_index(void);
     bool alloc_dir_entry(int &track, int &sector, int &entry);
 
     bool is_block_free(int track, int sector);
@@ -142,6 +166,12 @@ private:
     FILE *the_file;         // File pointer for image file
     image_file_desc desc;   // Image file descriptor
     bool write_protected;   // Flag: image file write-protected
+    sector_cache *cache;    // Recently read sectors of the image file
+
+    dir_index_entry dir_index[DIR_INDEX_SIZE];  // Used directory entries in directory order
+    int dir_index_count;    // Number of entries in dir_index[] (-1 = index must be rebuilt)
+    uint8 dir_hash[DIR_HASH_SIZE];  // First entry of each file name hash chain (0xff = none)
+    int dir_find_pos;       // Directory position of the entry last returned by find_file()
 
     uint8 ram[0x800];       // 2k 1541 RAM
     uint8 dir[258];         // Buffer for directory blocks
@@ -47,8 +47,24 @@
  * Incompatibilities:
  * ------------------
  *
- *  - No GCR writing implemented (WriteSector is a ROM patch).
- *  - GCR disk images must be byte-aligned.
+ *  - The DOS writes and formats sectors through ROM patches (WriteSector,
+ *    FormatTrack). Custom drive code writing GCR bytes itself is captured
+ *    into the track under the head; dirty tracks are written back when the
+ *    head leaves the track, the motor stops, the track is dropped from the
+ *    pool or the emulation is paused. G64 tracks go back as they are, D64
+ *    tracks are decoded and only sectors with a valid header and data block
+ *    checksum make it back into the image.
+ *  - D64 tracks are GCR encoded (and G64 tracks read) on first use into a
+ *    small pool of slots rather than all at mount time. The least recently
+ *    used track is dropped (and re-read from the image when needed again).
+ *  - G64 tracks are a bit stream: the byte framing restarts at the first
+ *    "0" bit after a sync mark, wherever that falls. The current track is
+ *    viewed through eight byte tables, one per bit shift, built lazily, so
+ *    reading a byte is still a single load. Syncs shorter than 17 "1" bits
+ *    that straddle the current framing may be missed.
+ *  - On G64 images the ROM patches patch the data block of the sector in
+ *    the GCR track, which is only found if its sync marks are byte-aligned.
+ *    Formatting a G64 track lays down a standard track if it fits.
  *  - Programs depending on the exact timing of head movement or doing
  *    bit rate and motor speed tricks don't work.
  */
@@ -64,6 +80,9 @@
 // Size of standard GCR sector encoded from D64 image
 constexpr unsigned GCR_SECTOR_SIZE = 5 + 10 + 9 + 5 + 325 + 12;	// SYNC + Header + Gap + SYNC + Data + Gap
 
+// Size of the longest D64 track (21 sectors) - one slot of the encoded track pool
+constexpr unsigned GCR_MAX_TRACK_SIZE = GCR_SECTOR_SIZE * 21;
+
 // Duration of disk change sequence step in cycles
 constexpr unsigned DISK_CHANGE_SEQ_CYCLES = 500000;	// 0.5 s
 
@@ -107,17 +126,31 @@ Job1541::Job1541(uint8_t *ram1541) : ram(ram1541), the_file(nullptr)
 	cycles_per_byte = 30;
 	last_byte_cycle = 0;
 	byte_latch = 0;
+	write_latch = 0x55;
 
 	motor_on = false;
 	write_protected = false;
 	on_sync = false;
 	byte_ready = false;
+	write_mode = false;
 
 	for (unsigned i = 0; i < MAX_NUM_HALFTRACKS; ++i) {
 		gcr_data[i] = nullptr;
 		gcr_track_length[i] = 0;
 	}
 
+	gcr_pool = nullptr;
+	gcr_slot_size = 0;
+	gcr_lru_clock = 0;
+
+	g64_image = false;
+	gcr_view_buf = nullptr;
+	gcr_view_halftrack = MAX_NUM_HALFTRACKS;
+	gcr_shift = 0;
+
+	num_sync_runs = 0;
+	sync_index_halftrack = MAX_NUM_HALFTRACKS;
+
 	if (TheDrivePrefs.TrueDrive) {
 		open_image_file(TheDrivePrefs.DrivePath[0]);
 	}
@@ -142,12 +175,16 @@ void Job1541::Reset()
 {
 	current_halftrack = 2 * (18 - 1);	// Track 18
 	gcr_offset = 0;
+	gcr_shift = 0;
 
 	disk_change_seq = 0;
 
+	FlushTracks();
+
 	motor_on = false;
 	on_sync = false;
 	byte_ready = false;
+	write_mode = false;
 }
 
 
@@ -201,8 +238,10 @@ void Job1541::open_image_file(const std::string & filepath)
 	write_protected = false;
 
 	// Check file type
-	int type = FILE_IMAGE;
-	if (type != FILE_IMAGE)
+	int type;
+	if (!IsMountableFile(filepath.c_str(), type))
+		return;
+	if (type != FILE_IMAGE && type != FILE_GCR_IMAGE)
 		return;
 
 	// Try opening the file for reading/writing first, then for reading only
@@ -218,7 +257,11 @@ void Job1541::open_image_file(const std::string & filepath)
 
 	// Load image file
 	bool ok = false;
-    ok = load_image_file();
+	if (type == FILE_IMAGE) {
+		ok = load_image_file();
+	} else {
+		ok = load_gcr_file();
+	}
 
 	if (ok) {
 		// Set write protect status
@@ -236,13 +279,23 @@ void Job1541::open_image_file(const std::string & filepath)
 
 void Job1541::close_image_file()
 {
-	// Deallocate GCR data
+	FlushTracks();
+
+	// Deallocate GCR data - all tracks live in the pool
 	for (unsigned i = 0; i < MAX_NUM_HALFTRACKS; ++i) {
-		delete[] gcr_data[i];
 		gcr_data[i] = nullptr;
 		gcr_track_length[i] = 0;
 	}
 
+	delete[] gcr_pool;
+	gcr_pool = nullptr;
+	delete[] gcr_view_buf;
+	gcr_view_buf = nullptr;
+	gcr_view_halftrack = MAX_NUM_HALFTRACKS;
+	gcr_shift = 0;
+	g64_image = false;
+	sync_index_halftrack = MAX_NUM_HALFTRACKS;
+
 	// Close file
 	if (the_file != nullptr) {
 		fclose(the_file);
@@ -330,22 +383,284 @@ bool Job1541::load_image_file()
 	disk_id1 = bam[162];
 	disk_id2 = bam[163];
 
-	// Create GCR encoded disk data from image
+	// Tracks are GCR encoded from the image when the head first needs them
 	for (unsigned track = 1; track <= num_tracks; ++track) {
-
-		// Allocate GCR data
 		unsigned halftrack = (track - 1) * 2;
-
 		gcr_track_length[halftrack] = GCR_SECTOR_SIZE * num_sectors[track];
-		gcr_data[halftrack] = new uint8_t[gcr_track_length[halftrack]];
+	}
+
+	gcr_slot_size = GCR_MAX_TRACK_SIZE;
+	gcr_pool = new uint8_t[GCR_CACHE_TRACKS * gcr_slot_size];
+	for (unsigned slot = 0; slot < GCR_CACHE_TRACKS; ++slot) {
+		gcr_slot_halftrack[slot] = MAX_NUM_HALFTRACKS;
+		gcr_slot_used[slot] = 0;
+		gcr_slot_dirty[slot] = false;
+	}
+
+	return true;
+}
 
-		// Convert track
+
+/*
+ *  Bring one half-track into the least recently used slot of the pool (GCR
+ *  encoded from a D64 image or read as-is from a G64 image)
+ */
+
+uint8_t * Job1541::load_track(unsigned halftrack)
+{
+	// Pick a free slot or the one used longest ago - never the track under the head
+	unsigned victim = 0;
+	for (unsigned slot = 0; slot < GCR_CACHE_TRACKS; ++slot) {
+		if (gcr_slot_halftrack[slot] == MAX_NUM_HALFTRACKS) {
+			victim = slot;
+			break;
+		}
+		if (gcr_slot_halftrack[slot] != current_halftrack && gcr_slot_used[slot] < gcr_slot_used[victim]) {
+			victim = slot;
+		}
+	}
+
+	if (gcr_slot_halftrack[victim] < MAX_NUM_HALFTRACKS) {
+		flush_track(victim);
+		gcr_data[gcr_slot_halftrack[victim]] = nullptr;
+	}
+
+	uint8_t * gcr = gcr_pool + gcr_slot_size * victim;
+	if (g64_image) {
+		memset(gcr, 0x55, gcr_track_length[halftrack]);
+		fseek(the_file, g64_track_offset[halftrack], SEEK_SET);
+		fread(gcr, gcr_track_length[halftrack], 1, the_file);
+	} else {
+		unsigned track = halftrack / 2 + 1;
 		for (unsigned sector = 0; sector < num_sectors[track]; ++sector) {
-			sector2gcr(track, sector, gcr_data[halftrack] + GCR_SECTOR_SIZE * sector);
+			sector2gcr(track, sector, gcr + GCR_SECTOR_SIZE * sector);
 		}
 	}
 
-	return true;
+	if (halftrack == gcr_view_halftrack) {
+		gcr_view_halftrack = MAX_NUM_HALFTRACKS;
+	}
+
+	gcr_slot_halftrack[victim] = halftrack;
+	gcr_slot_used[victim] = ++gcr_lru_clock;
+	gcr_data[halftrack] = gcr;
+
+	return gcr;
+}
+
+
+/*
+ *  Head arrived on a half-track - mark it as the most recently used one
+ */
+
+void Job1541::touch_track()
+{
+	if (gcr_pool == nullptr || gcr_data[current_halftrack] == nullptr)
+		return;
+
+	unsigned slot = (gcr_data[current_halftrack] - gcr_pool) / gcr_slot_size;
+	gcr_slot_used[slot] = ++gcr_lru_clock;
+}
+
+
+/*
+ *  R/W head writes the latched GCR byte to the next count bytes of the track
+ */
+
+void Job1541::write_bytes(uint32_t count)
+{
+	size_t track_length = gcr_track_length[current_halftrack];
+	if (count > track_length) {
+		count = track_length;
+	}
+
+	size_t first = gcr_offset + 1;
+	if (first >= track_length) {
+		first = 0;
+	}
+	gcr_offset = (gcr_offset + count) % track_length;
+
+	if (write_protected)	// Write gate is held off
+		return;
+
+	uint8_t * p = gcr_data[current_halftrack];
+	size_t offset = first;
+	for (uint32_t i = 0; i < count; ++i) {
+		p[offset] = write_latch;
+		if (++offset == track_length) {
+			offset = 0;
+		}
+	}
+
+	mark_dirty(current_halftrack, first, count);
+}
+
+
+/*
+ *  Grow the dirty span of the slot holding a half-track to cover count
+ *  bytes written from GCR offset first on (wrapping around)
+ */
+
+void Job1541::mark_dirty(unsigned halftrack, size_t first, size_t count)
+{
+	size_t track_length = gcr_track_length[halftrack];
+	unsigned slot = (gcr_data[halftrack] - gcr_pool) / gcr_slot_size;
+	if (!gcr_slot_dirty[slot]) {
+		gcr_slot_dirty[slot] = true;
+		gcr_dirty_start[slot] = first;
+		gcr_dirty_length[slot] = count;
+	} else {
+		size_t end = (first + track_length - gcr_dirty_start[slot]) % track_length + count;
+		if (end > gcr_dirty_length[slot]) {
+			gcr_dirty_length[slot] = (end < track_length) ? end : track_length;
+		}
+	}
+
+	if (halftrack == gcr_view_halftrack) {
+		gcr_view_halftrack = MAX_NUM_HALFTRACKS;
+	}
+	if (halftrack == sync_index_halftrack) {
+		sync_index_halftrack = MAX_NUM_HALFTRACKS;
+	}
+}
+
+
+/*
+ *  Write back the track in a pool slot if the drive has written to it -
+ *  G64 tracks as they are, D64 tracks by decoding the data blocks that
+ *  overlap the written span
+ */
+
+void Job1541::flush_track(unsigned slot)
+{
+	if (!gcr_slot_dirty[slot])
+		return;
+	gcr_slot_dirty[slot] = false;
+
+	unsigned halftrack = gcr_slot_halftrack[slot];
+	const uint8_t * p = gcr_pool + gcr_slot_size * slot;
+	size_t track_length = gcr_track_length[halftrack];
+
+	if (the_file == nullptr || write_protected)
+		return;
+
+	floppy_soundfx(1);   // Play floppy SFX if needed
+
+	if (g64_image) {
+		fseek(the_file, g64_track_offset[halftrack], SEEK_SET);
+		fwrite(p, track_length, 1, the_file);
+		return;
+	}
+
+	if (halftrack & 1)	// D64 images have no half-tracks
+		return;
+	unsigned track = halftrack / 2 + 1;
+
+	// Follow the sync marks once around the track (and into the next turn
+	// for a data block whose header is at the end of the track)
+	uint8_t block[260];
+	uint32_t written = 0;
+	int sector = -1;
+	for (size_t i = 0; i < track_length + GCR_SECTOR_SIZE; ++i) {
+		size_t offset = i % track_length;
+		if (p[offset] != 0xff || p[(offset + 1) % track_length] == 0xff)
+			continue;
+
+		size_t start = (offset + 1) % track_length;	// First byte after the sync
+		if (!gcr_decode(p, track_length, start, block, 4))
+			continue;
+
+		if (block[0] == 0x08) {					// Header mark
+			sector = (block[3] == track && block[2] < num_sectors[track]) ? block[2] : -1;
+
+		} else if (block[0] == 0x07 && sector >= 0) {	// Data mark
+			size_t rel = (start + track_length - gcr_dirty_start[slot]) % track_length;
+			bool touched = rel < gcr_dirty_length[slot] || rel + 325 > track_length;
+
+			if (touched && !(written & (1 << sector)) && gcr_decode(p, track_length, start, block, 260)) {
+				uint8_t sum = 0;
+				for (unsigned j = 1; j <= 256; ++j) {
+					sum ^= block[j];
+				}
+				if (sum == block[257] && write_sector(track, sector, block + 1)) {
+					written |= 1 << sector;
+				}
+			}
+			sector = -1;
+		}
+	}
+}
+
+
+/*
+ *  Write all tracks the drive has written to back to the image file
+ */
+
+void Job1541::FlushTracks()
+{
+	if (gcr_pool == nullptr)
+		return;
+
+	for (unsigned slot = 0; slot < GCR_CACHE_TRACKS; ++slot) {
+		flush_track(slot);
+	}
+}
+
+
+/*
+ *  Byte view of the current track with the framing shifted by the given
+ *  number of bits - built on first use, byte i holds bits 8*i+shift..8*i+shift+7
+ */
+
+const uint8_t * Job1541::track_view(unsigned shift)
+{
+	const uint8_t * p = gcr_data[current_halftrack];
+	if (shift == 0)
+		return p;
+
+	if (gcr_view_halftrack != current_halftrack) {
+		for (unsigned i = 1; i < 8; ++i) {
+			gcr_view[i] = nullptr;
+		}
+		gcr_view_halftrack = current_halftrack;
+	}
+
+	if (gcr_view[shift] == nullptr) {
+		uint8_t * view = gcr_view_buf + gcr_slot_size * (shift - 1);
+		size_t track_length = gcr_track_length[current_halftrack];
+		for (size_t i = 0; i < track_length - 1; ++i) {
+			view[i] = (p[i] << shift) | (p[i + 1] >> (8 - shift));
+		}
+		view[track_length - 1] = (p[track_length - 1] << shift) | (p[0] >> (8 - shift));	// Track wraps around
+		gcr_view[shift] = view;
+	}
+
+	return gcr_view[shift];
+}
+
+
+/*
+ *  First byte after a sync mark on a G64 track: the drive frames bytes
+ *  from the first "0" bit on, so move the framing past any leading "1"s
+ */
+
+void Job1541::realign_after_sync()
+{
+	const uint8_t * p = track_view(gcr_shift);
+
+	unsigned ones = 0;
+	for (uint8_t b = p[gcr_offset]; b & 0x80; b <<= 1) {
+		++ones;
+	}
+	if (ones == 0)
+		return;
+
+	unsigned bit = gcr_shift + ones;
+	gcr_shift = bit & 7;
+	gcr_offset += bit >> 3;
+	if (gcr_offset >= gcr_track_length[current_halftrack]) {
+		gcr_offset -= gcr_track_length[current_halftrack];
+	}
 }
 
 
@@ -357,12 +672,18 @@ bool Job1541::load_gcr_file()
 {
 	// Read header
 	uint8_t header[12];
-	fread(header, sizeof(header), 1, the_file);
+	fseek(the_file, 0, SEEK_SET);
+	if (fread(header, sizeof(header), 1, the_file) != 1)
+		return false;
 
 	unsigned num_halftracks = header[9];
 	if (num_halftracks > MAX_NUM_HALFTRACKS)
 		return false;
 
+	size_t max_track_size = header[10] | (header[11] << 8);
+	if (max_track_size == 0 || max_track_size > G64_MAX_TRACK_SIZE)
+		return false;
+
 	num_tracks = num_halftracks / 2;
 	header_size = 0;	// Not relevant for GCR image
 
@@ -371,7 +692,7 @@ bool Job1541::load_gcr_file()
 	memset(track_offsets, 0, sizeof(track_offsets));
 	fread(track_offsets, num_halftracks * 4, 1, the_file);
 
-	// Read GCR data from file
+	// Note where the GCR data of each track is - it is read when the head first needs it
 	for (unsigned halftrack = 0; halftrack < num_halftracks; ++halftrack) {
 		uint32_t offset = ((uint32_t) track_offsets[halftrack * 4 + 0] <<  0)
 		                | ((uint32_t) track_offsets[halftrack * 4 + 1] <<  8)
@@ -386,12 +707,26 @@ bool Job1541::load_gcr_file()
 		fread(len, sizeof(len), 1, the_file);
 
 		uint16_t length = len[0] | (len[1] << 8);
+		if (length == 0 || length > max_track_size)
+			continue;
 
 		gcr_track_length[halftrack] = length;
-		gcr_data[halftrack] = new uint8_t[length];
-		fread(gcr_data[halftrack], length, 1, the_file);
+		g64_track_offset[halftrack] = offset + 2;
 	}
 
+	g64_image = true;
+	gcr_slot_size = max_track_size;
+	gcr_pool = new uint8_t[GCR_CACHE_TRACKS * gcr_slot_size];
+	for (unsigned slot = 0; slot < GCR_CACHE_TRACKS; ++slot) {
+		gcr_slot_halftrack[slot] = MAX_NUM_HALFTRACKS;
+		gcr_slot_used[slot] = 0;
+		gcr_slot_dirty[slot] = false;
+	}
+
+	gcr_view_buf = new uint8_t[7 * gcr_slot_size];
+	gcr_view_halftrack = MAX_NUM_HALFTRACKS;
+	gcr_shift = 0;
+
 	return true;
 }
 
@@ -410,8 +745,11 @@ void Job1541::WriteSector()
 	uint16_t buf = ram[0x30] | (ram[0x31] << 8);
 
 	if (buf <= 0x0700) {
-		if (write_sector(track, sector, ram + buf)) {
+		if (g64_image) {
+			g64_write_sector(track, sector, ram + buf);
+		} else if (write_sector(track, sector, ram + buf) && gcr_data[halftrack] != nullptr) {
 			sector2gcr(track, sector, gcr_data[halftrack] + GCR_SECTOR_SIZE * sector);
+			sync_index_halftrack = MAX_NUM_HALFTRACKS;
 		}
 	}
 }
@@ -438,10 +776,17 @@ void Job1541::FormatTrack()
 	memset(buf, 1, 256);
 	buf[0] = 0x4b;
 
+	// A G64 track gets a standard layout in place of whatever was there
+	if (g64_image) {
+		g64_format_track(track, buf);
+		return;
+	}
+
 	// Write block to all sectors on track
 	for (unsigned sector = 0; sector < num_sectors[track]; ++sector) {
-		if (write_sector(track, sector, buf)) {
+		if (write_sector(track, sector, buf) && gcr_data[halftrack] != nullptr) {
 			sector2gcr(track, sector, gcr_data[halftrack] + GCR_SECTOR_SIZE * sector);
+			sync_index_halftrack = MAX_NUM_HALFTRACKS;
 		}
 	}
 
@@ -453,6 +798,80 @@ void Job1541::FormatTrack()
 }
 
 
+/*
+ *  G64 images: replace the data block of a sector in the GCR track and
+ *  leave the write-back to flush_track() - false if the sector is not found
+ */
+
+bool Job1541::g64_write_sector(unsigned track, unsigned sector, const uint8_t *buffer)
+{
+	if (the_file == nullptr || write_protected || track < 1 || track > 40)
+		return false;
+
+	unsigned halftrack = (track - 1) * 2;
+	size_t track_length = gcr_track_length[halftrack];
+	if (track_length == 0)
+		return false;
+
+	floppy_soundfx(1);   // Play floppy SFX if needed
+
+	uint8_t * p = gcr_data[halftrack] ? gcr_data[halftrack] : load_track(halftrack);
+
+	// Follow the sync marks to the header of the sector and the data block after it
+	uint8_t block[4];
+	bool header_found = false;
+	for (size_t i = 0; i < track_length + GCR_SECTOR_SIZE; ++i) {
+		size_t offset = i % track_length;
+		if (p[offset] != 0xff || p[(offset + 1) % track_length] == 0xff)
+			continue;
+
+		size_t start = (offset + 1) % track_length;	// First byte after the sync
+		if (!gcr_decode(p, track_length, start, block, 4))
+			continue;
+
+		if (block[0] == 0x08) {					// Header mark
+			header_found = (block[3] == track && block[2] == sector);
+
+		} else if (block[0] == 0x07 && header_found) {	// Data mark
+			uint8_t gcr[GCR_SECTOR_SIZE];
+			block2gcr(track, sector, buffer, ERR_OK, gcr);
+			const uint8_t * data = gcr + 5 + 10 + 9 + 5;	// Data block past its SYNC
+			for (unsigned j = 0; j < 325; ++j) {
+				p[(start + j) % track_length] = data[j];
+			}
+			mark_dirty(halftrack, start, 325);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/*
+ *  G64 images: lay down a standard track of empty blocks, padded with gap
+ *  bytes to the length the image has for it (left alone if it won't fit)
+ */
+
+void Job1541::g64_format_track(unsigned track, const uint8_t *buffer)
+{
+	if (the_file == nullptr || write_protected || track < 1 || track > 40)
+		return;
+
+	unsigned halftrack = (track - 1) * 2;
+	size_t track_length = gcr_track_length[halftrack];
+	size_t format_length = GCR_SECTOR_SIZE * num_sectors[track];
+	if (track_length == 0 || format_length > track_length)
+		return;
+
+	uint8_t * p = gcr_data[halftrack] ? gcr_data[halftrack] : load_track(halftrack);
+	for (unsigned sector = 0; sector < num_sectors[track]; ++sector) {
+		block2gcr(track, sector, buffer, ERR_OK, p + GCR_SECTOR_SIZE * sector);
+	}
+	memset(p + format_length, 0x55, track_length - format_length);
+	mark_dirty(halftrack, 0, track_length);
+}
+
+
 /*
  *  Read sector (256 bytes) from image file, return DOS error code (ERR_*)
  */
@@ -551,6 +970,42 @@ void Job1541::gcr_conv4(const uint8_t * from, uint8_t * to)
 }
 
 
+/*
+ *  Convert GCR bytes at an offset of a track (wrapping around) back to count
+ *  bytes (multiple of 4), false if an invalid GCR code is found
+ */
+
+const uint8_t gcr_decode_table[32] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x08, 0x00, 0x01, 0xff, 0x0c, 0x04, 0x05,
+	0xff, 0xff, 0x02, 0x03, 0xff, 0x0f, 0x06, 0x07,
+	0xff, 0x09, 0x0a, 0x0b, 0xff, 0x0d, 0x0e, 0xff
+};
+
+bool Job1541::gcr_decode(const uint8_t * track, size_t track_length, size_t offset, uint8_t * to, unsigned count)
+{
+	for (unsigned i = 0; i < count; i += 4) {
+		uint64_t g = 0;
+		for (unsigned j = 0; j < 5; ++j) {
+			g = (g << 8) | track[offset];
+			if (++offset == track_length) {
+				offset = 0;
+			}
+		}
+
+		for (unsigned j = 0; j < 4; ++j) {
+			uint8_t hi = gcr_decode_table[(g >> (35 - 10 * j)) & 0x1f];
+			uint8_t lo = gcr_decode_table[(g >> (30 - 10 * j)) & 0x1f];
+			if ((hi | lo) == 0xff)
+				return false;
+			to[i + j] = (hi << 4) | lo;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  *  Create GCR encoded disk data from image
  */
@@ -558,9 +1013,20 @@ void Job1541::gcr_conv4(const uint8_t * from, uint8_t * to)
 void Job1541::sector2gcr(unsigned track, unsigned sector, uint8_t * gcr)
 {
 	uint8_t block[256];
-	uint8_t buf[4];
 
 	int error = read_sector(track, sector, block);
+	block2gcr(track, sector, block, error, gcr);
+}
+
+
+/*
+ *  GCR encode one sector (header, data block and gaps) with the given
+ *  DOS error code (ERR_*) worked into it
+ */
+
+void Job1541::block2gcr(unsigned track, unsigned sector, const uint8_t * block, int error, uint8_t * gcr)
+{
+	uint8_t buf[4];
 
 	uint8_t id1 = disk_id1;
 	uint8_t id2 = disk_id2;
@@ -634,6 +1100,35 @@ void Job1541::sector2gcr(unsigned track, unsigned sector, uint8_t * gcr)
 }
 
 
+/*
+ *  Spindle motor on/off - a stopping disk is a good moment to write back
+ */
+
+void Job1541::SetMotor(bool on)
+{
+	if (motor_on && !on) {
+		FlushTracks();
+	}
+	motor_on = on;
+}
+
+
+/*
+ *  Switch R/W head between reading and writing (VIA 2 CB2)
+ */
+
+void Job1541::SetWriteMode(bool on, uint32_t cycle_counter)
+{
+	if (on == write_mode)
+		return;
+
+	rotate_disk(cycle_counter);
+	write_mode = on;
+	gcr_shift = 0;		// Written bytes follow the unshifted framing
+	byte_ready = false;
+}
+
+
 /*
  *  Set read/write bit rate
  */
@@ -656,7 +1151,10 @@ void Job1541::MoveHeadOut()
 	if (current_halftrack == 0)
 		return;
 
+	FlushTracks();
 	--current_halftrack;
+	gcr_shift = 0;
+	touch_track();
 }
 
 
@@ -671,7 +1169,10 @@ void Job1541::MoveHeadIn()
 	if (current_halftrack >= MAX_NUM_HALFTRACKS - 1)
 		return;
 
+	FlushTracks();
 	++current_halftrack;
+	gcr_shift = 0;
+	touch_track();
 }
 
 
@@ -706,6 +1207,7 @@ void Job1541::SetState(const Job1541State * s)
 {
 	current_halftrack = s->current_halftrack;
 	gcr_offset = s->gcr_offset;
+	gcr_shift = 0;
 
 	cycles_per_byte = s->cycles_per_byte;
 	last_byte_cycle = s->last_byte_cycle;
@@ -747,37 +1249,56 @@ void Job1541::rotate_disk(uint32_t cycle_counter)
 {
 	advance_disk_change_seq(cycle_counter);
 
-	if (motor_on && disk_change_seq == 0 && gcr_data[current_halftrack] != nullptr)
+	if (motor_on && disk_change_seq == 0 && gcr_track_length[current_halftrack] != 0)
     {
+		// Encode or read the track on first use
+		if (gcr_data[current_halftrack] == nullptr) {
+			load_track(current_halftrack);
+		}
+
 		uint32_t elapsed = cycle_counter - last_byte_cycle;
 		uint32_t advance = elapsed / cycles_per_byte;
 
 		if (advance > 0)
         {
-			size_t track_length = gcr_track_length[current_halftrack];
-
-			gcr_offset += advance;
-			while (gcr_offset >= track_length) {
-				gcr_offset -= track_length;
-			}
+			if (write_mode) {
 
-			const uint8_t * p = gcr_data[current_halftrack] + gcr_offset;
+				// Head writes the latched byte, one byte is taken per byte time
+				write_bytes(advance);
+				on_sync = false;
+				byte_ready = true;
 
-			// Sync = ten "1" bits
-			if (gcr_offset != 0) {
-				on_sync = ((p[-1] & 0x03) == 0x03) && (p[0] == 0xff);
 			} else {
-				on_sync = ((gcr_data[current_halftrack][track_length - 1] & 0x03) == 0x03) && (p[0] == 0xff);
-			}
+				size_t track_length = gcr_track_length[current_halftrack];
 
-			// Byte is ready if not on sync
-			if (! on_sync) {
-				if (! byte_ready) {
-					byte_latch = p[0];
-					byte_ready = true;
+				gcr_offset += advance;
+				if (gcr_offset >= track_length) {
+					gcr_offset %= track_length;
+				}
+
+				const uint8_t * track = gcr_data[current_halftrack];
+				if (gcr_shift != 0) {
+					track = track_view(gcr_shift);
+				}
+				const uint8_t * p = track + gcr_offset;
+				uint8_t prev = (gcr_offset != 0) ? p[-1] : track[track_length - 1];
+
+				// Sync = ten "1" bits
+				on_sync = ((prev & 0x03) == 0x03) && (p[0] == 0xff);
+
+				// Byte is ready if not on sync
+				if (! on_sync) {
+					if (g64_image && prev == 0xff) {
+						realign_after_sync();
+						p = track_view(gcr_shift) + gcr_offset;
+					}
+					if (! byte_ready) {
+						byte_latch = p[0];
+						byte_ready = true;
+					}
+				} else {
+					byte_ready = false;
 				}
-			} else {
-				byte_ready = false;
 			}
 
 			last_byte_cycle += advance * cycles_per_byte;
@@ -793,6 +1314,97 @@ void Job1541::rotate_disk(uint32_t cycle_counter)
 }
 
 
+/*
+ *  Index the runs of sync bytes on the track under the head - a byte is on
+ *  sync when it and the last two bits of the one before it are all "1"s
+ */
+
+bool Job1541::build_sync_index()
+{
+	const uint8_t * p = gcr_data[current_halftrack];
+	size_t track_length = gcr_track_length[current_halftrack];
+
+	num_sync_runs = 0;
+	sync_index_halftrack = current_halftrack;
+
+	bool prev_sync = false;
+	uint8_t prev = p[track_length - 1];
+	for (size_t offset = 0; offset < track_length; ++offset) {
+		bool sync = ((prev & 0x03) == 0x03) && (p[offset] == 0xff);
+		if (sync && !prev_sync) {
+			if (num_sync_runs == MAX_SYNC_RUNS) {
+				sync_index_halftrack = MAX_NUM_HALFTRACKS;	// Too many to index - callers fall back to polling
+				return false;
+			}
+			sync_start[num_sync_runs++] = offset;
+		}
+		prev_sync = sync;
+		prev = p[offset];
+	}
+
+	return true;
+}
+
+
+/*
+ *  Number of cycles until the R/W head reaches the next SYNC (0 = on SYNC
+ *  now or can't tell, 0xffffffff = never while nothing changes)
+ */
+
+uint32_t Job1541::CyclesUntilSync(uint32_t cycle_counter)
+{
+	rotate_disk(cycle_counter);
+
+	if (on_sync || disk_change_seq != 0)
+		return 0;
+	if (!motor_on || gcr_track_length[current_halftrack] == 0)
+		return 0xffffffff;
+
+	if (sync_index_halftrack != current_halftrack && !build_sync_index())
+		return 0;
+	if (num_sync_runs == 0)
+		return 0xffffffff;
+
+	// Binary search for the first run starting after the byte under the head
+	unsigned lo = 0, hi = num_sync_runs;
+	while (lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+		if (sync_start[mid] <= gcr_offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	size_t bytes = (lo < num_sync_runs) ? (sync_start[lo] - gcr_offset)
+	                                    : (sync_start[0] + gcr_track_length[current_halftrack] - gcr_offset);
+
+	// The index is taken on the unshifted track - a G64 sync may show up a byte earlier in the current framing
+	if (g64_image && --bytes == 0)
+		return 0;
+
+	return last_byte_cycle + bytes * cycles_per_byte - cycle_counter;
+}
+
+
+/*
+ *  Number of cycles until the next GCR byte passes under the R/W head (0 = a
+ *  byte is ready now or can't tell, 0xffffffff = never while nothing changes)
+ */
+
+uint32_t Job1541::CyclesUntilByteReady(uint32_t cycle_counter)
+{
+	rotate_disk(cycle_counter);
+
+	if (byte_ready || disk_change_seq != 0)
+		return 0;
+	if (!motor_on || gcr_track_length[current_halftrack] == 0)
+		return 0xffffffff;
+
+	return last_byte_cycle + cycles_per_byte - cycle_counter;
+}
+
+
 /*
  *  Check if R/W head is over SYNC
  */
@@ -832,6 +1444,22 @@ uint8_t Job1541::ReadGCRByte(uint32_t cycle_counter)
 }
 
 
+/*
+ *  Latch GCR byte to be written (VIA 2 port A)
+ */
+
+void Job1541::WriteGCRByte(uint8_t byte, uint32_t cycle_counter)
+{
+	rotate_disk(cycle_counter);
+
+	write_latch = byte;
+	if (write_mode) {
+		floppy_soundfx(1);   // Play floppy SFX if needed
+		byte_ready = false;
+	}
+}
+
+
 /*
  *  Return state of write protect sensor
  */
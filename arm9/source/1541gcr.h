@@ -46,6 +46,15 @@
 // Number of supported half-tracks
 constexpr unsigned MAX_NUM_HALFTRACKS = 84;
 
+// Number of D64 half-tracks kept GCR encoded at any one time
+constexpr unsigned GCR_CACHE_TRACKS = 8;
+
+// Most sync marks indexed on one track (a D64 track has two per sector)
+constexpr unsigned MAX_SYNC_RUNS = 128;
+
+// Largest G64 track we accept (standard images use 7928 bytes)
+constexpr unsigned G64_MAX_TRACK_SIZE = 8192;
+
 
 class MOS6502_1541;
 class DrivePrefs;
@@ -66,19 +75,25 @@ public:
 	void SetState(const Job1541State * s);
 	void NewPrefs(const DrivePrefs * prefs);
 
-	void SetMotor(bool on) { motor_on = on; }
+	void SetMotor(bool on);
 	void SetBitRate(uint8_t rate);
+	void SetWriteMode(bool on, uint32_t cycle_counter);
 	void MoveHeadOut();
 	void MoveHeadIn();
 
 	bool SyncFound(uint32_t cycle_counter);
 	bool ByteReady(uint32_t cycle_counter);
+	uint32_t CyclesUntilSync(uint32_t cycle_counter);
+	uint32_t CyclesUntilByteReady(uint32_t cycle_counter);
 	uint8_t ReadGCRByte(uint32_t cycle_counter);
+	void WriteGCRByte(uint8_t byte, uint32_t cycle_counter);
 	bool WPSensorClosed(uint32_t cycle_counter);
 
 	void WriteSector();
 	void FormatTrack();
 
+	void FlushTracks();
+
 private:
 	void open_image_file(const std::string & filepath);
 	void close_image_file();
@@ -87,15 +102,27 @@ private:
 
 	int read_sector(unsigned track, unsigned sector, uint8_t *buffer);
 	bool write_sector(unsigned track, unsigned sector, const uint8_t *buffer);
+	bool g64_write_sector(unsigned track, unsigned sector, const uint8_t *buffer);
+	void g64_format_track(unsigned track, const uint8_t *buffer);
 	void format_disk();
 
 	int offset_from_ts(unsigned track, unsigned sector);
 
 	void gcr_conv4(const uint8_t * from, uint8_t * to);
+	bool gcr_decode(const uint8_t * track, size_t track_length, size_t offset, uint8_t * to, unsigned count);
 	void sector2gcr(unsigned track, unsigned sector, uint8_t * gcr);
+	void block2gcr(unsigned track, unsigned sector, const uint8_t * block, int error, uint8_t * gcr);
+	uint8_t * load_track(unsigned halftrack);
+	void touch_track();
+	void write_bytes(uint32_t count);
+	void mark_dirty(unsigned halftrack, size_t first, size_t count);
+	void flush_track(unsigned slot);
+	const uint8_t * track_view(unsigned shift);
+	void realign_after_sync();
 
 	void advance_disk_change_seq(uint32_t cycle_counter);
 	void rotate_disk(uint32_t cycle_counter);
+	bool build_sync_index();
 
 	uint8_t * ram;				// Pointer to 1541 RAM
 	MOS6502_1541 * the_cpu;		// Pointer to 1541 CPU object
@@ -107,8 +134,29 @@ private:
 	uint8_t disk_id1, disk_id2;			// ID of disk
 	uint8_t error_info[NUM_SECTORS_40];	// Sector error information (1 byte/sector)
 
-	uint8_t * gcr_data[MAX_NUM_HALFTRACKS];			// GCR data for each half-track (nullptr = not present)
-	size_t gcr_track_length[MAX_NUM_HALFTRACKS];	// Number of GCR bytes for each half-track (nullptr = not present)
+	uint8_t * gcr_data[MAX_NUM_HALFTRACKS];			// GCR data for each half-track (nullptr = not present or not encoded yet)
+	size_t gcr_track_length[MAX_NUM_HALFTRACKS];	// Number of GCR bytes for each half-track (0 = not present)
+
+	uint8_t * gcr_pool;							// GCR_CACHE_TRACKS tracks encoded from D64 or read from G64 (nullptr = no image)
+	size_t gcr_slot_size;						// Size of one slot of the pool
+	unsigned gcr_slot_halftrack[GCR_CACHE_TRACKS];	// Half-track held by each slot of the pool (MAX_NUM_HALFTRACKS = free)
+	uint32_t gcr_slot_used[GCR_CACHE_TRACKS];		// LRU stamp of each slot
+	uint32_t gcr_lru_clock;						// Source of the LRU stamps
+	bool gcr_slot_dirty[GCR_CACHE_TRACKS];			// Flag: Track in slot written by the drive, not flushed to the image yet
+	size_t gcr_dirty_start[GCR_CACHE_TRACKS];		// First written GCR offset of a dirty slot
+	size_t gcr_dirty_length[GCR_CACHE_TRACKS];		// Number of GCR bytes from there on (wrapping around) that may have been written
+
+	bool g64_image;								// Flag: G64 image mounted - bit stream need not be byte-aligned
+	uint32_t g64_track_offset[MAX_NUM_HALFTRACKS];	// File offset of the GCR data of each G64 half-track
+
+	uint8_t * gcr_view_buf;						// G64 images: current track shifted left by 1..7 bits
+	const uint8_t * gcr_view[8];				// Byte views of the current track for each bit shift (nullptr = not built yet)
+	unsigned gcr_view_halftrack;				// Half-track gcr_view[] was built for (MAX_NUM_HALFTRACKS = none)
+	unsigned gcr_shift;							// Bit offset of the byte framing on the current track (0..7)
+
+	uint16_t sync_start[MAX_SYNC_RUNS];			// GCR offsets where each run of sync bytes begins on the indexed track
+	unsigned num_sync_runs;						// Number of entries in sync_start[]
+	unsigned sync_index_halftrack;				// Half-track sync_start[] was built for (MAX_NUM_HALFTRACKS = none)
 
 	unsigned current_halftrack;		// Current halftrack number (0..MAX_NUM_HALFTRACKS-1)
 	size_t gcr_offset;				// Offset of GCR data byte under R/W head, relative to gcr_data[current_halftrack]
@@ -120,11 +168,13 @@ private:
 	unsigned cycles_per_byte;	// Clock cycles per GCR byte
 	uint32_t last_byte_cycle;	// Cycle when last byte was available
 	uint8_t byte_latch;			// Latch for read GCR byte
+	uint8_t write_latch;		// GCR byte to be written by the R/W head
 
 	bool motor_on;				// Flag: Spindle motor on
 	bool write_protected;		// Flag: Disk write-protected
 	bool on_sync;				// Flag: Sync detected
-	bool byte_ready;			// Flag: GCR byte ready for reading
+	bool byte_ready;			// Flag: GCR byte ready for reading (or writing)
+	bool write_mode;			// Flag: R/W head writing
 };
 
 
@@ -51,7 +51,9 @@
 #include "mainmenu.h"
 #include "diskmenu.h"
 #include "lzav.h"
+#include "lzavstream.h"
 #include <maxmod9.h>
+#include <time.h>
 #include "soundbank.h"
 #include "printf.h"
 
@@ -65,18 +67,18 @@ uint8 myCOLOR[0x400]            __attribute__((section(".dtcm")));  // Small eno
 uint8 myCHAR[CHAR_ROM_SIZE];
 
 uint8 bTurboWarp __attribute__((section(".dtcm"))) = 0; // Run the CPU as fast as possible
+uint8 bAutoWarp  __attribute__((section(".dtcm"))) = 0; // Running as fast as possible because the disk drive is busy
 uint8 cart_in    __attribute__((section(".dtcm"))) = 0; // Will be set to '1' if CART is inserted
 
 MOS6510 myCPU    __attribute__((section(".dtcm")));  // Put the entire CPU object into fast memory...
 
 C64 *gTheC64 = nullptr; // For occasional access in other classes without having to pass it around
 
-u8 CompressBuffer[300*1024]; //300K more than enough (might need to compress RDU at 256K)
 
 u8 turrican_hack = 0;
 int sync_frames = 0;
 
-#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_VERSION 5
 
 /*
  *  Constructor: Allocate objects and memory
@@ -111,6 +113,7 @@ C64::C64()
 
     TheVIC  = TheCPU->TheVIC  = new MOS6569(this, TheDisplay, TheCPU, RAM, Char, Color);
     TheSID  = TheCPU->TheSID  = new MOS6581(this);
+    TheSID2 = TheCPU->TheSID2 = new MOS6581(this, TheSID);
     TheCIA1 = TheCPU->TheCIA1 = new MOS6526_1(TheCPU, TheVIC);
     TheCIA2 = TheCPU->TheCIA2 = TheCPU1541->TheCIA2 = new MOS6526_2(TheCPU, TheVIC, TheCPU1541);
     TheIEC  = TheCPU->TheIEC  = new IEC(TheDisplay);
@@ -250,6 +253,7 @@ C64::~C64()
     delete TheIEC;
     delete TheCIA2;
     delete TheCIA1;
+    delete TheSID2;
     delete TheSID;
     delete TheVIC;
     delete TheCPU1541;
@@ -273,15 +277,21 @@ void C64::Reset(void)
     TheCPU1541->AsyncReset();
     TheJob1541->Reset();
     TheSID->Reset();
+    TheSID2->Reset();
     TheCIA1->Reset();
     TheCIA2->Reset();
     TheIEC->Reset();
     TheVIC->Reset();
     TheCart->Reset();
     if (myConfig.reuType) TheREU->Reset();
+    RewindReset();
 
     bTurboWarp = 0;
     dampen_drive_led = 1;
+    drive_activity = 0;
+
+    // Straight to READY. if this setup has booted before
+    boot_restore();
 }
 
 /*
@@ -302,31 +312,35 @@ void C64::LoadPRG(char *filename)
     FILE *fp = fopen(filename, "rb");
     if (fp)
     {
-        int prg_size = fread(CompressBuffer, 1, sizeof(CompressBuffer), fp);
-        fclose(fp);
-
-        uint8 start_hi, start_lo;
+        uint8 start_lo, start_hi;
         uint16 start;
 
-        u8 *prg = CompressBuffer;
-        start_lo=*prg++;
-        start_hi=*prg++;
-        start=(start_hi<<8)+start_lo;
-
-        for(int i=0; i<(prg_size-2); i++)
+        // Load address first, then the rest goes straight into RAM (up to the top of memory)
+        if (fread(&start_lo, 1, 1, fp) == 1 && fread(&start_hi, 1, 1, fp) == 1)
         {
-            myRAM[start+i]=prg[i];
+            start=(start_hi<<8)+start_lo;
+            (void)fread(myRAM + start, 1, C64_RAM_SIZE - start, fp);
         }
+        fclose(fp);
+        RewindReset();
     }
 }
 
 /*
  *  The preferences have changed. prefs is a pointer to the new
  *   preferences, TheDrivePrefs still holds the previous ones.
- *   The emulation must be in the paused state!
+ *   The emulation must be in the paused state! A G64 image in
+ *   drive 8 switches prefs->TrueDrive on whatever the caller asked.
  */
 void C64::NewPrefs(DrivePrefs *prefs)
 {
+    // A G64 image can only be read by the processor-level 1541 emulation
+    int type;
+    if (IsMountableFile(prefs->DrivePath[0], type) && (type == FILE_GCR_IMAGE))
+    {
+        prefs->TrueDrive = true;
+    }
+
     PatchKernal(prefs->TrueDrive);
     TheDisplay->NewPrefs(prefs);
 
@@ -345,6 +359,7 @@ void C64::NewPrefs(DrivePrefs *prefs)
     }
 
     TheSID->NewPrefs(prefs);
+    RewindReset();
 
     // Reset 1541 processor if turned on or off (to bring IEC lines back to sane state)
     if (TheDrivePrefs.TrueDrive != prefs->TrueDrive)
@@ -387,6 +402,8 @@ void C64::PatchKernal(bool true_drive)
         Kernal[0x0dcd] = 0x20;
         Kernal[0x0e03] = 0x20;
         Kernal[0x0e04] = 0xbe;
+        Kernal[0x14a5] = 0x85;
+        Kernal[0x14a6] = 0x93;
     } else {
         Kernal[0x0d40] = 0xf2;  // IECOut
         Kernal[0x0d41] = 0x00;
@@ -404,6 +421,8 @@ void C64::PatchKernal(bool true_drive)
         Kernal[0x0dcd] = 0x06;
         Kernal[0x0e03] = 0xf2;  // IECRelease
         Kernal[0x0e04] = 0x07;
+        Kernal[0x14a5] = 0xf2;  // IECLoad
+        Kernal[0x14a6] = 0x08;
     }
 
     // 1541 - Fast Reset
@@ -443,6 +462,168 @@ void C64::PatchKernal(bool true_drive)
 }
 
 
+/*
+ *  Snapshot chunks: every piece of state is stored as a tagged chunk with its
+ *  own layout version, length and CRC32 so that a loader can check each one,
+ *  skip what it doesn't know and find pieces in any order.
+ */
+
+#define CHUNK_ID(a,b,c,d)   ((a) | ((b) << 8) | ((c) << 16) | ((d) << 24))
+
+#define CHUNK_VIC   CHUNK_ID('V','I','C',' ')
+#define CHUNK_SID   CHUNK_ID('S','I','D',' ')
+#define CHUNK_SID2  CHUNK_ID('S','I','D','2')
+#define CHUNK_CIA1  CHUNK_ID('C','I','A','1')
+#define CHUNK_CIA2  CHUNK_ID('C','I','A','2')
+#define CHUNK_CPU   CHUNK_ID('C','P','U',' ')
+#define CHUNK_RAM   CHUNK_ID('R','A','M',' ')
+#define CHUNK_COLOR CHUNK_ID('C','O','L','R')
+#define CHUNK_CART  CHUNK_ID('C','A','R','T')
+#define CHUNK_REU   CHUNK_ID('R','E','U',' ')
+#define CHUNK_REU_RAM CHUNK_ID('R','E','U','R')
+#define CHUNK_1541  CHUNK_ID('1','5','4','1')
+#define CHUNK_1541_RAM CHUNK_ID('D','R','A','M')
+#define CHUNK_JOB   CHUNK_ID('J','O','B',' ')
+#define CHUNK_END   CHUNK_ID('E','N','D',' ')
+#define CHUNK_META  CHUNK_ID('M','E','T','A')
+#define CHUNK_THUMB CHUNK_ID('T','H','M','B')
+
+#define CHUNK_RAW   0       // Stored as is
+#define CHUNK_LZAV_STREAM 2 // Stored as lzav compressed 16K windows (see lzavstream.h)
+
+struct SnapshotChunk {
+    uint32 id;              // CHUNK_xxx
+    uint8  version;         // Layout version of this chunk
+    uint8  compression;     // CHUNK_RAW or CHUNK_LZAV_STREAM
+    uint16 reserved;
+    uint32 length;          // Bytes stored after this header
+    uint32 raw_length;      // Bytes once decompressed
+    uint32 crc;             // CRC32 of the stored bytes
+};
+
+// 1541 processor state goes along with the image it was running on
+struct Snapshot1541 {
+    char path[256];
+    MOS6502State state;
+};
+
+static MOS6569State snapshot_vic;   // Set again once everything else is loaded
+static bool snapshot_fast = false;  // Use the fast compressor (quick-save slots)
+static bool snapshot_raw = false;   // Store every chunk as is (boot image)
+
+static bool stage_chunk(uint32 id, uint8 version, const void *data, int len, bool compress);
+
+
+/*
+ *  Write one chunk, compressing it first if asked to (and if that pays off)
+ */
+
+static bool write_chunk(FILE *f, uint32 id, uint8 version, const void *data, int len, bool compress = false)
+{
+    SnapshotChunk chunk;
+    uint8 *stored = (uint8 *)data;
+
+    // No file - the chunk goes to the staging buffer of a background save
+    if (f == NULL) return stage_chunk(id, version, data, len, compress);
+
+    chunk.id = id;
+    chunk.version = version;
+    chunk.compression = CHUNK_RAW;
+    chunk.reserved = 0;
+    chunk.length = chunk.raw_length = len;
+
+    if (compress && len > 0 && !snapshot_raw)
+    {
+        // ---------------------------------------------------------
+        // Compress the data using 'high' compression ratio (or the
+        // fast one when a quick-save has to fit in a single frame)
+        // a window at a time straight to the file - the header goes
+        // in first as a placeholder and is filled in afterwards.
+        // ---------------------------------------------------------
+        long hdr_pos = ftell(f);
+        chunk.compression = CHUNK_LZAV_STREAM;
+        chunk.crc = 0;
+        if (fwrite(&chunk, sizeof(chunk), 1, f) != 1) return false;
+
+        u32 crc = 0xFFFFFFFF;
+        int stored_len = lzav_stream_write(f, data, len, !snapshot_fast, &crc);
+        if (stored_len < 0) return false;
+
+        long end_pos = ftell(f);
+        chunk.length = stored_len;
+        chunk.crc = ~crc;
+        bool ok = (fseek(f, hdr_pos, SEEK_SET) == 0) && (fwrite(&chunk, sizeof(chunk), 1, f) == 1);
+        return ok && (fseek(f, end_pos, SEEK_SET) == 0);
+    }
+    chunk.crc = getCRC32(stored, chunk.length);
+
+    int i = fwrite(&chunk, sizeof(chunk), 1, f);
+    if (chunk.length) i += fwrite(stored, chunk.length, 1, f); else i++;
+    return i == 2;
+}
+
+
+/*
+ *  Read the payload of a chunk into 'to', which must be exactly len bytes once
+ *  decompressed. Fails on a layout version this loader doesn't know, an
+ *  unexpected length, a short read or a bad CRC. Small raw chunks (the chip
+ *  states) are checked before 'to' is touched; RAM-sized ones are checked as
+ *  they are read in, each byte read just once - LoadSnapshot() resets the
+ *  machine if any chunk fails.
+ */
+
+static bool read_chunk(FILE *f, SnapshotChunk *chunk, void *to, int len, uint8 version = 1)
+{
+    static uint8 scratch[2048];     // Kept out of the (small) DTCM stack
+
+    if (chunk->version != version || chunk->raw_length != (uint32)len) return false;
+
+    if (chunk->compression == CHUNK_LZAV_STREAM)
+    {
+        // ------------------------------------------------------------------
+        // Decompress the previously compressed data a window at a time right
+        // into its memory location... this is quite fast all things considered.
+        // ------------------------------------------------------------------
+        u32 crc = 0xFFFFFFFF;
+        return lzav_stream_read(f, to, len, chunk->length, &crc) && (~crc == chunk->crc);
+    }
+
+    if (chunk->compression != CHUNK_RAW || chunk->length != chunk->raw_length) return false;
+    if (chunk->length <= sizeof(scratch))
+    {
+        if (chunk->length && fread(scratch, chunk->length, 1, f) != 1) return false;
+        if (getCRC32(scratch, chunk->length) != chunk->crc) return false;
+        memcpy(to, scratch, chunk->length);
+        return true;
+    }
+    return (fread(to, chunk->length, 1, f) == 1) && (getCRC32((u8 *)to, chunk->length) == chunk->crc);
+}
+
+
+/*
+ *  Save the snapshot metadata and thumbnail - these go first so that reading
+ *  them never means reading past them
+ */
+
+bool C64::SaveMetaState(FILE *f)
+{
+    extern char CartFilename[];
+    static SnapshotMeta meta;
+    static uint8 thumb[SNAPSHOT_THUMB_SIZE];
+
+    memset(&meta, 0x00, sizeof(meta));
+    strncpy(meta.name, (strlen(CartFilename) > 1) ? CartFilename : TheDrivePrefs.DrivePath[0], sizeof(meta.name)-1);
+    meta.crc = file_crc;
+    meta.time = (uint32)time(NULL);
+    meta.true_drive = TheDrivePrefs.TrueDrive;
+    TheDisplay->GrabThumbnail(thumb);
+
+    bool ok = write_chunk(f, CHUNK_META, 1, &meta, sizeof(meta));
+    ok &= write_chunk(f, CHUNK_THUMB, 1, thumb, sizeof(thumb));
+    return ok;
+}
+
+
 /*
  *  Save CPU state to snapshot
  *
@@ -456,53 +637,35 @@ int C64::SaveCPUState(FILE *f)
     MOS6510State state;
     TheCPU->GetState(&state);
 
-    if (!state.instruction_complete)
-        return -1;
+    bool ok = write_chunk(f, CHUNK_CPU, 1, &state, sizeof(state));
+    ok &= write_chunk(f, CHUNK_RAM, 1, RAM, C64_RAM_SIZE, true);
+    ok &= write_chunk(f, CHUNK_COLOR, 1, Color, 0x400);
 
-    // ---------------------------------------------------------
-    // Compress the RAM data using 'high' compression ratio...
-    // ---------------------------------------------------------
-    int max_len = lzav_compress_bound_hi(0x10000);
-    int comp_len = lzav_compress_hi(RAM, CompressBuffer, 0x10000, max_len);
-
-    int i = 0;
-    i += fwrite(&comp_len,        sizeof(comp_len), 1, f);
-    i += fwrite(&CompressBuffer,  comp_len,         1, f);
-    i += fwrite(Color,            0x400,            1, f);
-    i += fwrite((void*)&state,    sizeof(state),    1, f);
-
-    return i == 4;
+    if (!ok) return 0;
+    return state.instruction_complete ? 1 : -1;
 }
 
 
 /*
- *  Load CPU state from snapshot
+ *  Load CPU state (or RAM) from snapshot chunk
  */
 
-bool C64::LoadCPUState(FILE *f)
+bool C64::LoadCPUState(FILE *f, SnapshotChunk *chunk)
 {
     MOS6510State state;
 
-    int comp_len = 0;
-    int i = 0;
-    i += fread(&comp_len,       sizeof(comp_len), 1, f);
-    i += fread(CompressBuffer,  comp_len,         1, f);
-    i += fread(Color, 0x400, 1, f);
-    i += fread((void*)&state, sizeof(state), 1, f);
-
-    if (i == 4)
+    switch (chunk->id)
     {
-        // ------------------------------------------------------------------
-        // Decompress the previously compressed RAM and put it back into the
-        // right memory location... this is quite fast all things considered.
-        // ------------------------------------------------------------------
-        (void)lzav_decompress( CompressBuffer, RAM, comp_len, 0x10000 );
-
-        TheCPU->SetState(&state);
-        return true;
+        case CHUNK_RAM:
+            return read_chunk(f, chunk, RAM, C64_RAM_SIZE);
+        case CHUNK_COLOR:
+            return read_chunk(f, chunk, Color, 0x400);
+        default:
+            if (!read_chunk(f, chunk, &state, sizeof(state)))
+            { iprintf("LoadCPUState Failed"); return false;}
+            TheCPU->SetState(&state);
+            return true;
     }
-    else
-    { iprintf("LoadCPUState Failed"); return false;}
 }
 
 
@@ -516,35 +679,41 @@ bool C64::LoadCPUState(FILE *f)
 
 int C64::Save1541State(FILE *f)
 {
-    MOS6502State state;
-    TheCPU1541->GetState(&state);
-
-    if (!state.idle && !state.instruction_complete)
-        return -1;
+    static Snapshot1541 drive;  // Too big for the DTCM stack
+    memcpy(drive.path, TheDrivePrefs.DrivePath[0], sizeof(drive.path));
+    TheCPU1541->GetState(&drive.state);
 
-    int i = fwrite(RAM1541, 0x800, 1, f);
-    i += fwrite((void*)&state, sizeof(state), 1, f);
+    bool ok = write_chunk(f, CHUNK_1541, 1, &drive, sizeof(drive));
+    ok &= write_chunk(f, CHUNK_1541_RAM, 1, RAM1541, DRIVE_RAM_SIZE);
 
-    return i == 2;
+    if (!ok) return 0;
+    return (drive.state.idle || drive.state.instruction_complete) ? 1 : -1;
 }
 
 
 /*
- *  Load 1541 state from snapshot
+ *  Load 1541 state from snapshot chunk - switches on the processor-level 1541
  */
 
-bool C64::Load1541State(FILE *f)
+bool C64::Load1541State(FILE *f, SnapshotChunk *chunk)
 {
-    MOS6502State state;
+    static Snapshot1541 drive;
 
-    int i = fread(RAM1541, 0x800, 1, f);
-    i += fread((void*)&state, sizeof(state), 1, f);
-    if (i == 2)
-    {
-        TheCPU1541->SetState(&state);
-        return true;
-    } else
+    if (chunk->id == CHUNK_1541_RAM)
+        return read_chunk(f, chunk, RAM1541, DRIVE_RAM_SIZE);
+
+    if (!read_chunk(f, chunk, &drive, sizeof(drive)))
     { iprintf("Load1541State\n"); return false;}
+
+    DrivePrefs *prefs = new DrivePrefs(TheDrivePrefs);
+    memcpy(prefs->DrivePath[0], drive.path, sizeof(drive.path));
+    prefs->TrueDrive = true;
+    NewPrefs(prefs);
+    TheDrivePrefs = *prefs;
+    delete prefs;
+
+    TheCPU1541->SetState(&drive.state);
+    return true;
 }
 
 
@@ -556,25 +725,22 @@ bool C64::SaveVICState(FILE *f)
 {
     MOS6569State state;
     TheVIC->GetState(&state);
-    return fwrite((void*)&state, sizeof(state), 1, f) == 1;
+    return write_chunk(f, CHUNK_VIC, 1, &state, sizeof(state));
 }
 
 
 /*
- *  Load VIC state from snapshot
+ *  Load VIC state from snapshot chunk
  */
 
-bool C64::LoadVICState(FILE *f)
+bool C64::LoadVICState(FILE *f, SnapshotChunk *chunk)
 {
-    MOS6569State state;
-
-    int k = fread((void*)&state, sizeof(state), 1, f);
-    if (k == 1)
+    if (read_chunk(f, chunk, &snapshot_vic, sizeof(snapshot_vic)))
     {
-        TheVIC->SetState(&state);
+        TheVIC->SetState(&snapshot_vic);
         return true;
     } else
-    { iprintf("LoadVICState %d\n",k); return false;}
+    { iprintf("LoadVICState\n"); return false;}
 }
 
 
@@ -586,21 +752,33 @@ bool C64::SaveSIDState(FILE *f)
 {
     MOS6581State state;
     TheSID->GetState(&state);
-    return fwrite((void*)&state, sizeof(state), 1, f) == 1;
+    if (!write_chunk(f, CHUNK_SID, 1, &state, sizeof(state))) return false;
+
+    // The second SID follows only when this game has one mapped
+    if (myConfig.sid2Addr)
+    {
+        TheSID2->GetState(&state);
+        return write_chunk(f, CHUNK_SID2, 1, &state, sizeof(state));
+    }
+    return true;
 }
 
 
 /*
- *  Load SID state from snapshot
+ *  Load SID state from snapshot chunk
  */
 
-bool C64::LoadSIDState(FILE *f)
+bool C64::LoadSIDState(FILE *f, SnapshotChunk *chunk)
 {
     MOS6581State state;
 
-    if (fread((void*)&state, sizeof(state), 1, f) == 1)
+    // A second SID the current game doesn't map is left alone
+    if (chunk->id == CHUNK_SID2 && !myConfig.sid2Addr) return true;
+
+    if (read_chunk(f, chunk, &state, sizeof(state)))
     {
-        TheSID->SetState(&state);
+        if (chunk->id == CHUNK_SID2) TheSID2->SetState(&state);
+        else TheSID->SetState(&state);
         return true;
     } else
     { iprintf("LoadSIDState\n"); return false;}
@@ -616,10 +794,10 @@ bool C64::SaveCIAState(FILE *f)
     MOS6526State state;
     TheCIA1->GetState(&state);
 
-    if (fwrite((void*)&state, sizeof(state), 1, f) == 1)
+    if (write_chunk(f, CHUNK_CIA1, 1, &state, sizeof(state)))
     {
         TheCIA2->GetState(&state);
-        return fwrite((void*)&state, sizeof(state), 1, f) == 1;
+        return write_chunk(f, CHUNK_CIA2, 1, &state, sizeof(state));
     }
     else
     {
@@ -629,22 +807,19 @@ bool C64::SaveCIAState(FILE *f)
 
 
 /*
- *  Load CIA states from snapshot
+ *  Load CIA state from snapshot chunk
  */
 
-bool C64::LoadCIAState(FILE *f)
+bool C64::LoadCIAState(FILE *f, SnapshotChunk *chunk)
 {
     MOS6526State state;
 
-    if (fread((void*)&state, sizeof(state), 1, f) == 1)
+    if (read_chunk(f, chunk, &state, sizeof(state)))
     {
-        TheCIA1->SetState(&state);
-        if (fread((void*)&state, sizeof(state), 1, f) == 1)
-        {
-            TheCIA2->SetState(&state);
-            return true;
-        } else { iprintf("LoadCIAState1\n"); return false;}
-    } else { iprintf("LoadCIAState2\n"); return false;}
+        if (chunk->id == CHUNK_CIA2) TheCIA2->SetState(&state);
+        else TheCIA1->SetState(&state);
+        return true;
+    } else { iprintf("LoadCIAState\n"); return false;}
 }
 
 /*
@@ -655,265 +830,1470 @@ bool C64::SaveCARTState(FILE *f)
 {
     CartridgeState state;
     TheCart->GetState(&state);
-    return fwrite((void*)&state, sizeof(state), 1, f) == 1;
+    return write_chunk(f, CHUNK_CART, 1, &state, sizeof(state));
 }
 
 /*
- *  Load Cartridge state from snapshot
+ *  Load Cartridge state from snapshot chunk
  */
 
-bool C64::LoadCARTState(FILE *f)
+bool C64::LoadCARTState(FILE *f, SnapshotChunk *chunk)
 {
     CartridgeState state;
 
-    if (fread((void*)&state, sizeof(state), 1, f) == 1)
+    if (read_chunk(f, chunk, &state, sizeof(state)))
+    {
+        TheCart->SetState(&state);
+        return true;
+    } else { iprintf("LoadCARTState\n"); return false;}
+}
+
+
+/*
+ *  Save REU state to snapshot
+ */
+
+bool C64::SaveREUState(FILE *f)
+{
+    if (myConfig.reuType)
+    {
+        REUState state;
+        TheREU->GetState(&state);
+
+        bool ok = write_chunk(f, CHUNK_REU_RAM, 1, REU_RAM, 256*1024, true);
+        ok &= write_chunk(f, CHUNK_REU, 1, &state, sizeof(state));
+        return ok;
+    }
+    else
+    {
+        return true;
+    }
+}
+
+/*
+ *  Load REU state (or REU RAM) from snapshot chunk
+ */
+
+bool C64::LoadREUState(FILE *f, SnapshotChunk *chunk)
+{
+    REUState state;
+
+    // Not enabled for the current game - nothing to put it in
+    if (!myConfig.reuType) return true;
+
+    if (chunk->id == CHUNK_REU_RAM)
+        return read_chunk(f, chunk, REU_RAM, 256*1024);
+
+    if (read_chunk(f, chunk, &state, sizeof(state)))
+    {
+        TheREU->SetState(&state);
+        return true;
+    }
+    else
+    { iprintf("LoadREUState Failed"); return false;}
+}
+
+
+/*
+ *  Save 1541 GCR state to snapshot
+ */
+
+bool C64::Save1541JobState(FILE *f)
+{
+    Job1541State state;
+    TheJob1541->GetState(&state);
+    return write_chunk(f, CHUNK_JOB, 1, &state, sizeof(state));
+}
+
+
+/*
+ *  Load 1541 GCR state from snapshot chunk
+ */
+
+bool C64::Load1541JobState(FILE *f, SnapshotChunk *chunk)
+{
+    Job1541State state;
+
+    if (read_chunk(f, chunk, &state, sizeof(state)))
+    {
+        TheJob1541->SetState(&state);
+        return true;
+    } else { iprintf("Load1541JobState\n"); return false;}
+}
+
+
+#define SNAPSHOT_HEADER  "GimliSnapshot"
+#define SNAPSHOT_1541    1
+
+
+/*
+ *  Snapshot index: one fixed size record per .GSS file in the same directory,
+ *  keyed by its file name and holding a copy of its META and THMB chunks. It
+ *  is brought up to date whenever a snapshot has been written.
+ */
+
+#define SNAPSHOT_INDEX   "GimliDS.idx"
+
+struct SnapshotIndexEntry {
+    char file[64];          // Snapshot file name without the directory
+    SnapshotMeta meta;
+    uint8 thumb[SNAPSHOT_THUMB_SIZE];
+};
+
+static SnapshotIndexEntry index_entry;  // Too big for the DTCM stack
+
+// Put the index file next to the snapshot into index_path, return the bare snapshot name
+static const char *snapshot_index_path(const char *filename, char *index_path)
+{
+    const char *base = strrchr(filename, '/');
+    base = base ? base+1 : filename;
+    sprintf(index_path, "%.*s%s", (int)(base - filename), filename, SNAPSHOT_INDEX);
+    return base;
+}
+
+// Read the META and THMB chunks from the front of a snapshot
+static bool read_snapshot_meta(FILE *f, SnapshotMeta *meta, uint8 *thumb)
+{
+    char line[20];
+    SnapshotChunk chunk;
+    bool have_meta = false, have_thumb = false;
+
+    if (fgets(line, sizeof(line), f) == NULL || strcmp(line, SNAPSHOT_HEADER "\n") != 0) return false;
+    if (fgetc(f) != SNAPSHOT_VERSION) return false;
+    (void)fgetc(f);     // Flags
+
+    while (!(have_meta && have_thumb) && fread(&chunk, sizeof(chunk), 1, f) == 1)
+    {
+        if (chunk.id == CHUNK_META)
+        {
+            if (!(have_meta = read_chunk(f, &chunk, meta, sizeof(*meta)))) break;
+        }
+        else if (chunk.id == CHUNK_THUMB)
+        {
+            if (!(have_thumb = read_chunk(f, &chunk, thumb, SNAPSHOT_THUMB_SIZE))) break;
+        }
+        else break;     // Nothing up front - written before snapshots had them
+    }
+    return have_meta && have_thumb;
+}
+
+// Find the record of a snapshot or the end of the index
+static long index_seek(FILE *f, const char *name)
+{
+    char file[64];
+    long pos = 0;
+
+    while (fread(file, sizeof(file), 1, f) == 1 && strncmp(file, name, sizeof(file)) != 0)
+    {
+        pos += sizeof(SnapshotIndexEntry);
+        fseek(f, pos, SEEK_SET);
+    }
+    fseek(f, pos, SEEK_SET);
+    return pos;
+}
+
+static void snapshot_index_update(const char *filename)
+{
+    char index_path[300];
+    const char *base = snapshot_index_path(filename, index_path);
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) return;
+    bool ok = read_snapshot_meta(f, &index_entry.meta, index_entry.thumb);
+    fclose(f);
+    if (!ok) return;
+
+    memset(index_entry.file, 0x00, sizeof(index_entry.file));
+    strncpy(index_entry.file, base, sizeof(index_entry.file)-1);
+
+    if ((f = fopen(index_path, "r+b")) == NULL && (f = fopen(index_path, "w+b")) == NULL) return;
+    index_seek(f, index_entry.file);
+    fwrite(&index_entry, sizeof(index_entry), 1, f);
+    fclose(f);
+}
+
+// Look a snapshot up in the index - the snapshot file itself is not opened
+bool SnapshotIndexFind(const char *filename, SnapshotMeta *meta, uint8 *thumb)
+{
+    char index_path[300];
+    char name[64];
+    const char *base = snapshot_index_path(filename, index_path);
+
+    memset(name, 0x00, sizeof(name));
+    strncpy(name, base, sizeof(name)-1);
+
+    FILE *f = fopen(index_path, "rb");
+    if (f == NULL) return false;
+    index_seek(f, name);
+    bool ok = (fread(&index_entry, sizeof(index_entry), 1, f) == 1) && (strncmp(index_entry.file, name, sizeof(name)) == 0);
+    fclose(f);
+
+    if (ok)
+    {
+        memcpy(meta, &index_entry.meta, sizeof(*meta));
+        memcpy(thumb, index_entry.thumb, SNAPSHOT_THUMB_SIZE);
+    }
+    return ok;
+}
+
+/*
+ *  Save snapshot (emulation must be paused and in VBlank)
+ *
+ *  The file is the header line, the version and flag bytes and then a list
+ *  of chunks ending with an END chunk.
+ */
+
+bool C64::SaveSnapshot(char *filename)
+{
+    FILE *f;
+
+    if (strlen(filename) < 5) return false;
+
+    if ((f = fopen(filename, "wb")) == NULL)
+    {
+        //ShowRequester("Unable to open snapshot file", "OK", NULL);
+        return false;
+    }
+
+    bool ok = save_snapshot(f);
+    fclose(f);
+    if (ok) snapshot_index_update(filename);
+    return ok;
+}
+
+
+/*
+ *  Write a complete snapshot to an open file (or memory stream)
+ */
+
+bool C64::save_snapshot(FILE *f)
+{
+    uint8 flags;
+
+    fprintf(f, "%s%c", SNAPSHOT_HEADER, 10);
+    fputc(SNAPSHOT_VERSION, f); // Version number
+    flags = 0;
+    if (TheDrivePrefs.TrueDrive) flags |= SNAPSHOT_1541;
+    fputc(flags, f);
+    bool bMetaSave = SaveMetaState(f);
+    bool bVICSave  = SaveVICState(f);
+    bool bSIDSave  = SaveSIDState(f);
+    bool bCIASave  = SaveCIAState(f);
+    bool bCPUSave  = SaveCPUState(f);
+    bool bCARTSave = SaveCARTState(f);
+    bool bREUSave  = SaveREUState(f);
+
+    if (TheDrivePrefs.TrueDrive)
+    {
+        bCPUSave &= (Save1541State(f) != 0);
+        bCPUSave &= Save1541JobState(f);
+    }
+    bool bEndSave = write_chunk(f, CHUNK_END, 1, NULL, 0);
+
+    if (bMetaSave && bVICSave && bSIDSave && bCIASave && bCPUSave && bCARTSave && bREUSave && bEndSave) return true;
+    return false;
+}
+
+
+/*
+ *  Background snapshot save: the chunks are staged in RAM in one go (while the
+ *  emulation is paused), then compressed and written to a temporary file a
+ *  slice at a time from VBlank while the game keeps running. The finished file
+ *  replaces the previous snapshot only once it has been written completely -
+ *  the old one is kept under a backup name until then (see snapshot_recover).
+ */
+
+#define SAVE_SLICE          4096    // Bytes of an uncompressed chunk written to the SD card per frame
+#define MAX_STAGED_CHUNKS   20
+
+static struct {
+    uint32 id;
+    uint8  version;
+    uint8  compress;
+    int    offset;      // Position of the raw chunk data in stage_buf
+    int    length;
+} staged[MAX_STAGED_CHUNKS];
+
+static uint8 *stage_buf = NULL;     // Raw data of the staged chunks
+static int stage_size;              // Bytes allocated for stage_buf
+static int stage_len;               // Bytes used in stage_buf
+static int staged_count;            // Number of staged chunks
+
+static FILE *save_file = NULL;      // Temporary file being written, NULL when no save is running
+static char save_path[300];         // Final snapshot file name
+static char save_tmp_path[300];     // Temporary file name
+static char save_bak_path[300];     // The previous snapshot while the new one takes its place
+static SnapshotChunk save_hdr;      // Header of the chunk being written
+static uint8 *save_data;            // Raw data of the chunk being written
+static long save_hdr_pos;           // File position of its header (filled in once compressed)
+static u32 save_crc;                // Running CRC32 of what has been stored of it
+static int save_chunk;              // Index of the chunk being written
+static int save_pos;                // Raw bytes of it written so far, -1 before its header
+static bool save_ok;                // No write has failed so far
+static int save_msg_frames = 0;     // Frames left to show the outcome
+
+static bool stage_chunk(uint32 id, uint8 version, const void *data, int len, bool compress)
+{
+    if (staged_count >= MAX_STAGED_CHUNKS || stage_len + len > stage_size) return false;
+
+    staged[staged_count].id = id;
+    staged[staged_count].version = version;
+    staged[staged_count].compress = compress;
+    staged[staged_count].offset = stage_len;
+    staged[staged_count].length = len;
+    staged_count++;
+
+    if (len) memcpy(stage_buf + stage_len, data, len);
+    stage_len += len;
+    return true;
+}
+
+static void free_save_buffers(void)
+{
+    free(stage_buf); stage_buf = NULL;
+}
+
+/*
+ *  Name of the backup a snapshot is kept under while a new one replaces it
+ */
+
+static void snapshot_bak_path(char *bak, const char *filename)
+{
+    strcpy(bak, filename);
+    bak[strlen(bak)-1] = '_';
+}
+
+/*
+ *  A save cut short between taking the old snapshot out of the way and
+ *  putting the new one in place leaves only the backup - put it back
+ */
+
+static void snapshot_recover(const char *filename)
+{
+    static char bak[300];
+    FILE *f;
+
+    if (strlen(filename) < 5) return;
+    if ((f = fopen(filename, "rb")) != NULL) {fclose(f); return;}
+
+    snapshot_bak_path(bak, filename);
+    rename(bak, filename);
+}
+
+void C64::FinishSnapshotSave(void)
+{
+    while (save_file) SaveSnapshotSlice();
+}
+
+bool C64::StartSnapshotSave(char *filename)
+{
+    // Only one save at a time - finish the previous one first
+    FinishSnapshotSave();
+
+    if (strlen(filename) < 5) return false;
+
+    // The REU's 256K is staged along with the rest - a copy, as the game keeps writing to it
+    stage_size = sizeof(SnapshotMeta) + SNAPSHOT_THUMB_SIZE + sizeof(MOS6569State) + 2*sizeof(MOS6581State) + 2*sizeof(MOS6526State) + sizeof(MOS6510State)
+               + C64_RAM_SIZE + 0x400 + sizeof(CartridgeState) + sizeof(Snapshot1541) + DRIVE_RAM_SIZE + sizeof(Job1541State);
+    if (myConfig.reuType) stage_size += 256*1024 + sizeof(REUState);
+    stage_buf = (uint8 *)malloc(stage_size);
+    if (stage_buf == NULL) return SaveSnapshot(filename);   // Not enough memory to stage it - save the blocking way
+    stage_len = staged_count = 0;
+
+    uint8 flags = 0;
+    if (TheDrivePrefs.TrueDrive) flags |= SNAPSHOT_1541;
+    bool ok = SaveMetaState(NULL);
+    ok &= SaveVICState(NULL);
+    ok &= SaveSIDState(NULL);
+    ok &= SaveCIAState(NULL);
+    ok &= (SaveCPUState(NULL) != 0);
+    ok &= SaveCARTState(NULL);
+    ok &= SaveREUState(NULL);
+    if (TheDrivePrefs.TrueDrive)
+    {
+        ok &= (Save1541State(NULL) != 0);
+        ok &= Save1541JobState(NULL);
+    }
+    ok &= write_chunk(NULL, CHUNK_END, 1, NULL, 0);
+
+    strcpy(save_path, filename);
+    strcpy(save_tmp_path, filename);
+    save_tmp_path[strlen(save_tmp_path)-1] = '~';
+    snapshot_bak_path(save_bak_path, filename);
+
+    if (!ok || (save_file = fopen(save_tmp_path, "wb")) == NULL)
+    {
+        free_save_buffers();
+        return false;
+    }
+
+    fprintf(save_file, "%s%c", SNAPSHOT_HEADER, 10);
+    fputc(SNAPSHOT_VERSION, save_file);
+    fputc(flags, save_file);
+
+    save_chunk = 0;
+    save_pos = -1;
+    save_ok = true;
+    return true;
+}
+
+/*
+ *  One slice of the background save - called every VBlank. Compresses and
+ *  writes one 16K window of a chunk, or up to SAVE_SLICE bytes of one that is
+ *  stored as is, then shows the progress.
+ */
+
+void C64::SaveSnapshotSlice(void)
+{
+    char tmp[12];
+
+    if (save_file == NULL)
+    {
+        if (save_msg_frames && --save_msg_frames == 0) DSPrint(23, 0, 0, (char*)"         ");
+        return;
+    }
+
+    if (save_chunk < staged_count)
+    {
+        if (save_pos < 0)
+        {
+            // Start of a chunk: write its header - a placeholder if it is to be compressed
+            save_hdr.id = staged[save_chunk].id;
+            save_hdr.version = staged[save_chunk].version;
+            save_hdr.compression = CHUNK_RAW;
+            save_hdr.reserved = 0;
+            save_hdr.length = save_hdr.raw_length = staged[save_chunk].length;
+            save_data = stage_buf + staged[save_chunk].offset;
+            save_crc = 0xFFFFFFFF;
+
+            if (staged[save_chunk].compress && save_hdr.length)
+            {
+                save_hdr.compression = CHUNK_LZAV_STREAM;
+                save_hdr.length = 0;
+                save_hdr.crc = 0;
+                save_hdr_pos = ftell(save_file);
+            }
+            else save_hdr.crc = getCRC32(save_data, save_hdr.length);
+
+            save_ok &= (fwrite(&save_hdr, sizeof(save_hdr), 1, save_file) == 1);
+            save_pos = 0;
+        }
+        else if (save_hdr.compression == CHUNK_LZAV_STREAM)
+        {
+            // The fast compressor keeps a window to a millisecond or so
+            int len = save_hdr.raw_length - save_pos;
+            if (len > LZAV_STREAM_WINDOW) len = LZAV_STREAM_WINDOW;
+            int stored_len = lzav_stream_window(save_file, save_data + save_pos, len, false, &save_crc);
+            save_ok &= (stored_len > 0);
+            if (stored_len > 0) save_hdr.length += stored_len;
+            save_pos += len;
+
+            if (save_pos >= (int)save_hdr.raw_length)
+            {
+                // Now the header can say how it came out
+                long end_pos = ftell(save_file);
+                save_hdr.crc = ~save_crc;
+                save_ok &= (fseek(save_file, save_hdr_pos, SEEK_SET) == 0);
+                save_ok &= (fwrite(&save_hdr, sizeof(save_hdr), 1, save_file) == 1);
+                save_ok &= (fseek(save_file, end_pos, SEEK_SET) == 0);
+            }
+        }
+        else
+        {
+            int len = save_hdr.length - save_pos;
+            if (len > SAVE_SLICE) len = SAVE_SLICE;
+            save_ok &= (fwrite(save_data + save_pos, len, 1, save_file) == 1);
+            save_pos += len;
+        }
+
+        if (save_pos >= (int)save_hdr.raw_length)
+        {
+            save_chunk++;
+            save_pos = -1;
+        }
+
+        sprintf(tmp, "SAVE %3d%%", (staged[save_chunk < staged_count ? save_chunk : staged_count-1].offset * 100) / stage_len);
+        DSPrint(23, 0, 0, tmp);
+        return;
+    }
+
+    // All written - now the new snapshot takes the place of the old one
+    save_ok &= (fclose(save_file) == 0);
+    save_file = NULL;
+    free_save_buffers();
+
+    if (save_ok)
+    {
+        // FAT won't rename onto an existing file - move the old snapshot aside first
+        // and drop it only once the new one is in place (or put it back if that fails)
+        remove(save_bak_path);
+        bool had_old = (rename(save_path, save_bak_path) == 0);
+        save_ok = (rename(save_tmp_path, save_path) == 0);
+        if (save_ok)
+        {
+            if (had_old) remove(save_bak_path);
+            snapshot_index_update(save_path);
+        }
+        else
+        {
+            if (had_old) rename(save_bak_path, save_path);
+            remove(save_tmp_path);
+        }
+    }
+    else remove(save_tmp_path);
+
+    DSPrint(23, 0, 0, save_ok ? (char*)"  SAVED  " : (char*)"SAVE FAIL");
+    save_msg_frames = 100;
+}
+
+
+/*
+ *  Load snapshot (emulation must be paused and in VBlank)
+ */
+
+bool C64::LoadSnapshot(char *filename)
+{
+    FILE *f;
+
+    snapshot_recover(filename);
+    if ((f = fopen(filename, "rb")) != NULL) {
+        MovieStop();
+        bool ok = load_snapshot(f);
+        fclose(f);
+        return ok;
+    } else {
+        return false;
+    }
+}
+
+
+/*
+ *  Read a complete snapshot from an open file (or memory stream)
+ */
+
+bool C64::load_snapshot(FILE *f)
+{
+    char Header[] = SNAPSHOT_HEADER;
+    char *b = Header, c = 0;
+
+    // For some reason memcmp()/strcmp() and so forth utterly fail here.
+    while (*b > 32) {
+        if ((c = fgetc(f)) != *b++) {
+            b = NULL;
+            break;
+        }
+    }
+    if (b == NULL) return false;
+
+    bool error = false;
+    bool have_1541 = false;
+    bool have_end = false;
+
+    while (c != 10)
+        c = fgetc(f);   // Shouldn't be necessary
+    if (fgetc(f) != SNAPSHOT_VERSION) return false;
+    (void)fgetc(f);     // Flags - the chunks tell us what is there
+
+    SnapshotChunk chunk;
+    while (!error && !have_end && fread(&chunk, sizeof(chunk), 1, f) == 1)
+    {
+        long next = ftell(f) + chunk.length;
+
+        switch (chunk.id)
+        {
+            case CHUNK_VIC:     error |= !LoadVICState(f, &chunk);  break;
+            case CHUNK_SID:
+            case CHUNK_SID2:    error |= !LoadSIDState(f, &chunk);  break;
+            case CHUNK_CIA1:
+            case CHUNK_CIA2:    error |= !LoadCIAState(f, &chunk);  break;
+            case CHUNK_CPU:
+            case CHUNK_RAM:
+            case CHUNK_COLOR:   error |= !LoadCPUState(f, &chunk);  break;
+            case CHUNK_CART:    error |= !LoadCARTState(f, &chunk); break;
+            case CHUNK_REU:
+            case CHUNK_REU_RAM: error |= !LoadREUState(f, &chunk);  break;
+            case CHUNK_1541:    have_1541 = true;  // Fall through
+            case CHUNK_1541_RAM:error |= !Load1541State(f, &chunk); break;
+            case CHUNK_JOB:     error |= !Load1541JobState(f, &chunk); break;
+            case CHUNK_END:     have_end = true; break;
+            default:            break;  // Unknown chunk - skip it
+        }
+
+        fseek(f, next, SEEK_SET);
+    }
+
+    if (!have_1541 && TheDrivePrefs.TrueDrive) {    // No emulation in snapshot, but currently active?
+        DrivePrefs *prefs = new DrivePrefs(TheDrivePrefs);
+        prefs->TrueDrive = false;
+        NewPrefs(prefs);
+        TheDrivePrefs = *prefs;
+        delete prefs;
+    }
+
+    RewindReset();
+
+    if (error || !have_end) {
+        Reset();
+        return false;
+    }
+
+    TheVIC->SetState(&snapshot_vic);    // Set VIC state twice (is REALLY necessary sometimes!)
+    return true;
+}
+
+
+/*
+ *  Quick-save slots: complete snapshots kept in memory (fmemopen streams in the
+ *  very same format as the .GSS files) so that saving and restoring takes a
+ *  single frame. Persisting a slot to SD is just writing its bytes out.
+ */
+
+#define QUICK_SLOTS     3
+
+static uint8 *quick_buf[QUICK_SLOTS] = {NULL};
+static long quick_len[QUICK_SLOTS] = {0};
+uint8 quick_slot = 0;               // Slot used by the QUICK SAVE/LOAD keys and menu
+
+bool C64::QuickSave(int slot)
+{
+    // Worst case every chunk is stored as is (plus a 2-byte header per compressed window)
+    int max_len = 64 + 20 * sizeof(SnapshotChunk) + 2 * 64 + sizeof(SnapshotMeta) + SNAPSHOT_THUMB_SIZE
+                + sizeof(MOS6569State) + 2*sizeof(MOS6581State) + 2*sizeof(MOS6526State) + sizeof(MOS6510State)
+                + C64_RAM_SIZE + 0x400 + sizeof(CartridgeState) + sizeof(Snapshot1541) + DRIVE_RAM_SIZE + sizeof(Job1541State)
+                + (myConfig.reuType ? (256*1024 + sizeof(REUState)) : 0);
+
+    uint8 *buf = (uint8 *)malloc(max_len);
+    if (buf == NULL) return false;
+
+    FILE *f = fmemopen(buf, max_len, "wb");
+    if (f == NULL) { free(buf); return false; }
+
+    snapshot_fast = true;   // Single frame - no time for the high ratio compressor
+    bool ok = save_snapshot(f);
+    snapshot_fast = false;
+    long len = ftell(f);
+    fclose(f);
+
+    if (!ok || len <= 0) { free(buf); return false; }
+
+    free(quick_buf[slot]);
+    quick_buf[slot] = (uint8 *)realloc(buf, len);
+    if (quick_buf[slot] == NULL) quick_buf[slot] = buf;
+    quick_len[slot] = len;
+    return true;
+}
+
+bool C64::QuickLoad(int slot)
+{
+    if (quick_buf[slot] == NULL) return false;
+
+    FILE *f = fmemopen(quick_buf[slot], quick_len[slot], "rb");
+    if (f == NULL) return false;
+
+    MovieStop();
+    bool ok = load_snapshot(f);
+    fclose(f);
+    return ok;
+}
+
+bool C64::QuickPersist(int slot, char *filename)
+{
+    if (quick_buf[slot] == NULL) return false;
+
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) return false;
+
+    bool ok = (fwrite(quick_buf[slot], quick_len[slot], 1, f) == 1);
+    ok &= (fclose(f) == 0);
+    if (ok) snapshot_index_update(filename);
+    return ok;
+}
+
+bool QuickSlotInfo(int slot, SnapshotMeta *meta, uint8 *thumb)
+{
+    if (quick_buf[slot] == NULL) return false;
+
+    FILE *f = fmemopen(quick_buf[slot], quick_len[slot], "rb");
+    if (f == NULL) return false;
+
+    bool ok = read_snapshot_meta(f, meta, thumb);
+    fclose(f);
+    return ok;
+}
+
+
+/*
+ *  Boot image: the machine as it stands the first time the kernal sits waiting
+ *  for a key at READY. after a reset. It is kept uncompressed in memory, so a
+ *  later reset with the same ROMs and setup restores it directly instead of
+ *  going through the whole boot again. Not taken with a cartridge, True Drive
+ *  or the REU (they boot differently or carry too much state along), and not
+ *  used while a movie runs so that replays boot exactly as the recording did.
+ */
+
+#define BOOT_CAPTURE_FRAMES 500     // Give up waiting for READY. after 10 seconds
+
+extern int kbd_feedbuf_pos;
+
+static uint8 *boot_image = NULL;
+static long boot_image_len = 0;
+static uint32 boot_image_key;       // ROMs and setup it was taken with
+static int boot_capture_frames = 0; // Frames left to wait for READY. - 0 when not waiting
+
+static uint32 boot_key(C64 *the_c64)
+{
+    uint32 crc = 0xFFFFFFFF;
+    crc = updateCRC32(crc, the_c64->Basic, BASIC_ROM_SIZE);
+    crc = updateCRC32(crc, the_c64->Kernal, KERNAL_ROM_SIZE);
+    crc = updateCRC32(crc, the_c64->Char, CHAR_ROM_SIZE);
+    crc = updateCRC32(crc, &myConfig.sid2Addr, 1);
+    return ~crc;
+}
+
+// Called at the end of Reset(): restore the boot image if it fits, else arrange to take one
+bool C64::boot_restore(void)
+{
+    boot_capture_frames = 0;
+    if (cart_in || TheDrivePrefs.TrueDrive || myConfig.reuType) return false;
+
+    uint32 key = boot_key(this);
+    if (boot_image && key == boot_image_key && movie_mode == MOVIE_OFF)
+    {
+        // A failed load resets - keep that reset from coming back here
+        uint8 *image = boot_image;
+        boot_image = NULL;
+
+        FILE *f = fmemopen(image, boot_image_len, "rb");
+        bool ok = (f != NULL) && load_snapshot(f);
+        if (f) fclose(f);
+
+        if (ok)
+        {
+            boot_image = image;
+            return true;
+        }
+        free(image);
+    }
+    boot_capture_frames = BOOT_CAPTURE_FRAMES;
+    return false;
+}
+
+// Called from VBlank while boot_capture_frames is set
+void C64::boot_capture(void)
+{
+    static MOS6510State cpu;    // Kept out of the (small) DTCM stack
+
+    // The screen editor's wait-for-a-key loop at $E5CD-$E5D4 with nothing typed yet
+    TheCPU->GetState(&cpu);
+    if (!cpu.instruction_complete || cpu.pc < 0xE5CD || cpu.pc > 0xE5D4 || RAM[0xC6] || kbd_feedbuf_pos)
+    {
+        boot_capture_frames--;
+        return;
+    }
+    boot_capture_frames = 0;
+
+    int max_len = 64 + 20 * sizeof(SnapshotChunk) + sizeof(SnapshotMeta) + SNAPSHOT_THUMB_SIZE
+                + sizeof(MOS6569State) + 2*sizeof(MOS6581State) + 2*sizeof(MOS6526State) + sizeof(MOS6510State)
+                + C64_RAM_SIZE + 0x400 + sizeof(CartridgeState);
+
+    uint8 *buf = (uint8 *)malloc(max_len);
+    if (buf == NULL) return;
+
+    FILE *f = fmemopen(buf, max_len, "wb");
+    if (f == NULL) { free(buf); return; }
+
+    snapshot_raw = true;    // Restoring it should be no more than a copy
+    bool ok = save_snapshot(f);
+    snapshot_raw = false;
+    long len = ftell(f);
+    fclose(f);
+
+    if (!ok || len <= 0) { free(buf); return; }
+
+    free(boot_image);
+    boot_image = (uint8 *)realloc(buf, len);
+    if (boot_image == NULL) boot_image = buf;
+    boot_image_len = len;
+    boot_image_key = boot_key(this);
+}
+
+
+/*
+ *  The CPU marks the RAM pages it writes in ram_page_dirty. Those marks are
+ *  collected into a set for each user - rewind, run-ahead and the state hash -
+ *  so that each can clear its own set whenever it has dealt with it.
+ */
+
+uint8 ram_page_dirty[256] __attribute__((section(".dtcm")));   // RAM pages written since the last collect
+static uint8 rewind_dirty[256];     // ... since the last rewind capture
+static uint8 run_ahead_dirty[256];  // ... since the run-ahead shadow was last brought up to date
+static uint8 hash_dirty[256];       // ... since the last state hash
+
+static void collect_dirty_pages(void)
+{
+    // Zero page and stack are written without going through write_byte()
+    ram_page_dirty[0] = ram_page_dirty[1] = 1;
+    for (int page=0; page<256; page++)
+    {
+        rewind_dirty[page] |= ram_page_dirty[page];
+        run_ahead_dirty[page] |= ram_page_dirty[page];
+        hash_dirty[page] |= ram_page_dirty[page];
+    }
+    memset(ram_page_dirty, 0x00, sizeof(ram_page_dirty));
+}
+
+
+/*
+ *  Run-ahead: the real frames are emulated but not drawn. After each VBlank the
+ *  machine is saved, run myGlobalConfig.runAhead frames further on the input just
+ *  polled - only the last of those is drawn and none of them is heard - and put
+ *  back. The game then reacts to the pad that many frames sooner than it would.
+ *  Only RAM pages written since the last run-ahead go to the shadow copy, and
+ *  only pages the frames ahead wrote come back out of it.
+ */
+
+uint8 bRunAhead       __attribute__((section(".dtcm"))) = 0;   // Set while emulating the frames ahead
+uint8 run_ahead_abort __attribute__((section(".dtcm"))) = 0;   // Set when a frame ahead tried to use the drive
+uint32 run_ahead_ticks = 0;             // Timer ticks spent on the last run-ahead (debug display)
+
+static uint8 run_ahead_pending = 0;     // VBlank wants the next frame run ahead
+static uint8 run_ahead_synced = 0;      // The shadow RAM is good apart from the pages in run_ahead_dirty
+static uint8 *run_ahead_shadow = NULL;  // C64 RAM as of the last run-ahead
+static uint8 run_ahead_color[COLOR_RAM_SIZE];
+
+static struct {
+    MOS6510State cpu;
+    MOS6569State vic;
+    MOS6581State sid[2];
+    MOS6526State cia[2];
+    CartridgeState cart;
+} run_ahead_state;
+
+
+/*
+ *  Rewind: every REWIND_FRAMES frames the chip states are captured into a ring
+ *  of lzav-compressed records, together with the previous contents of each RAM
+ *  page written since the last capture (see collect_dirty_pages() above).
+ *  A shadow copy of RAM as of the newest record lets us step back one record
+ *  at a time by putting those pages back - no full 64K compress per capture.
+ */
+
+#define REWIND_FRAMES       25          // Capture twice a second
+#define REWIND_RING_SIZE    (256*1024)  // Room for the compressed records
+#define REWIND_MAX_RECORDS  128
+
+struct RewindHeader {
+    uint8 flags;            // SNAPSHOT_1541 when the 1541 processor state follows
+    uint8 sid2;             // Second SID was mapped
+    uint16 num_pages;       // Number of saved RAM pages (page number + 256 bytes each) at the end
+    MOS6510State cpu;
+    MOS6569State vic;
+    MOS6581State sid[2];
+    MOS6526State cia[2];
+    CartridgeState cart;
+};
+
+struct Rewind1541 {
+    MOS6502State cpu;
+    Job1541State job;
+};
+
+// Largest record: header, 1541 state and RAM, color RAM and every RAM page
+#define REWIND_WORK_SIZE    (sizeof(RewindHeader) + sizeof(Rewind1541) + DRIVE_RAM_SIZE + 0x400 + 256*257)
+
+static RewindHeader rewind_hdr;     // Kept out of the (small) DTCM stack
+static Rewind1541 rewind_1541;
+
+static uint8 *rewind_ring = NULL;   // REWIND_RING_SIZE bytes of compressed records
+static uint8 *rewind_shadow = NULL; // C64 RAM as of the newest record
+static uint8 *rewind_work = NULL;   // One record before compression / after decompression
+static struct {
+    int offset;
+    int length;
+} rewind_rec[REWIND_MAX_RECORDS];
+static int rewind_first = 0;        // Index of the oldest record
+static int rewind_count = 0;        // Number of records in the ring
+static int rewind_frames = REWIND_FRAMES;   // Frames until the next capture
+
+void C64::RewindReset(void)
+{
+    rewind_first = rewind_count = 0;
+    rewind_frames = REWIND_FRAMES;
+    memset(ram_page_dirty, 0x00, sizeof(ram_page_dirty));
+    memset(rewind_dirty, 0x00, sizeof(rewind_dirty));
+    run_ahead_synced = 0;
+    boot_capture_frames = 0;    // Whatever replaced the machine state wasn't a plain boot
+    StateHashReset();
+}
+
+void C64::RewindCapture(void)
+{
+    // The REU contents are too big to go along, so no rewind with an REU
+    if (myConfig.reuType) return;
+
+    if (rewind_ring == NULL)
+    {
+        rewind_ring = (uint8 *)malloc(REWIND_RING_SIZE);
+        rewind_shadow = (uint8 *)malloc(C64_RAM_SIZE);
+        rewind_work = (uint8 *)malloc(REWIND_WORK_SIZE);
+        if (rewind_ring == NULL || rewind_shadow == NULL || rewind_work == NULL)
+        {
+            free(rewind_ring);   rewind_ring = NULL;
+            free(rewind_shadow); rewind_shadow = NULL;
+            free(rewind_work);   rewind_work = NULL;
+            return;
+        }
+        RewindReset();
+    }
+
+    // Same rule as the snapshots: only between instructions (else try next frame)
+    TheCPU->GetState(&rewind_hdr.cpu);
+    if (!rewind_hdr.cpu.instruction_complete) return;
+    rewind_hdr.flags = 0;
+    if (TheDrivePrefs.TrueDrive)
+    {
+        TheCPU1541->GetState(&rewind_1541.cpu);
+        if (!rewind_1541.cpu.idle && !rewind_1541.cpu.instruction_complete) return;
+        TheJob1541->GetState(&rewind_1541.job);
+        rewind_hdr.flags = SNAPSHOT_1541;
+    }
+    rewind_hdr.sid2 = myConfig.sid2Addr;
+    TheVIC->GetState(&rewind_hdr.vic);
+    TheSID->GetState(&rewind_hdr.sid[0]);
+    TheSID2->GetState(&rewind_hdr.sid[1]);
+    TheCIA1->GetState(&rewind_hdr.cia[0]);
+    TheCIA2->GetState(&rewind_hdr.cia[1]);
+    TheCart->GetState(&rewind_hdr.cart);
+
+    // Build the record in rewind_work: header, 1541, color RAM, then the old RAM pages
+    uint8 *p = rewind_work + sizeof(rewind_hdr);
+    if (rewind_hdr.flags & SNAPSHOT_1541)
+    {
+        memcpy(p, &rewind_1541, sizeof(rewind_1541));   p += sizeof(rewind_1541);
+        memcpy(p, RAM1541, DRIVE_RAM_SIZE);             p += DRIVE_RAM_SIZE;
+    }
+    memcpy(p, Color, 0x400); p += 0x400;
+
+    rewind_hdr.num_pages = 0;
+    collect_dirty_pages();
+    if (rewind_count == 0)
+    {
+        // First record of the chain - nothing older to undo to
+        memcpy(rewind_shadow, RAM, C64_RAM_SIZE);
+    }
+    else
+    {
+        for (int page=0; page<256; page++)
+        {
+            if (!rewind_dirty[page]) continue;
+            uint8 *ram = RAM + (page << 8);
+            uint8 *shadow = rewind_shadow + (page << 8);
+            if (memcmp(ram, shadow, 256) == 0) continue;
+            *p++ = page;
+            memcpy(p, shadow, 256); p += 256;
+            memcpy(shadow, ram, 256);
+            rewind_hdr.num_pages++;
+        }
+    }
+    memcpy(rewind_work, &rewind_hdr, sizeof(rewind_hdr));
+    memset(rewind_dirty, 0x00, sizeof(rewind_dirty));
+
+    // Place it right after the newest record, wrapping at the end of the ring and
+    // dropping the oldest records that are in the way
+    int raw_len = p - rewind_work;
+    int max_len = lzav_compress_bound(raw_len);
+    int pos = 0;
+    if (rewind_count)
+    {
+        int newest = (rewind_first + rewind_count - 1) % REWIND_MAX_RECORDS;
+        pos = rewind_rec[newest].offset + rewind_rec[newest].length;
+    }
+    if (pos + max_len > REWIND_RING_SIZE) pos = 0;
+
+    while (rewind_count)
+    {
+        int oldest_offset = rewind_rec[rewind_first].offset;
+        int oldest_end = oldest_offset + rewind_rec[rewind_first].length;
+        if (rewind_count < REWIND_MAX_RECORDS && (oldest_offset >= pos + max_len || oldest_end <= pos)) break;
+        rewind_first = (rewind_first + 1) % REWIND_MAX_RECORDS;
+        rewind_count--;
+    }
+
+    int comp_len = lzav_compress_default(rewind_work, rewind_ring + pos, raw_len, max_len);
+    if (comp_len == 0)
     {
-        TheCart->SetState(&state);
-        return true;
-    } else { iprintf("LoadCARTState\n"); return false;}
+        RewindReset();  // The chain of undo pages is broken - start over
+        return;
+    }
+
+    int rec = (rewind_first + rewind_count) % REWIND_MAX_RECORDS;
+    rewind_rec[rec].offset = pos;
+    rewind_rec[rec].length = comp_len;
+    rewind_count++;
+    rewind_frames = REWIND_FRAMES;
 }
 
+// Decompress a record into rewind_work and return the header
+static RewindHeader *rewind_unpack(int rec)
+{
+    (void)lzav_decompress(rewind_ring + rewind_rec[rec].offset, rewind_work, rewind_rec[rec].length, REWIND_WORK_SIZE);
+    memcpy(&rewind_hdr, rewind_work, sizeof(rewind_hdr));
+    return &rewind_hdr;
+}
 
-/*
- *  Save REU state to snapshot
- */
+// Where the saved RAM pages of an unpacked record start
+static uint8 *rewind_pages(RewindHeader *hdr)
+{
+    uint8 *p = rewind_work + sizeof(RewindHeader);
+    if (hdr->flags & SNAPSHOT_1541) p += sizeof(Rewind1541) + DRIVE_RAM_SIZE;
+    return p + 0x400;
+}
 
-bool C64::SaveREUState(FILE *f)
+bool C64::RewindStep(void)
 {
-    if (myConfig.reuType)
+    if (rewind_count == 0) return false;
+
+    // Back to the newest record first - undo everything written since it was taken
+    collect_dirty_pages();
+    for (int page=0; page<256; page++)
     {
-        REUState state;
-        TheREU->GetState(&state);
+        if (rewind_dirty[page]) memcpy(RAM + (page << 8), rewind_shadow + (page << 8), 256);
+    }
+    memset(rewind_dirty, 0x00, sizeof(rewind_dirty));
+    run_ahead_synced = 0;
+    StateHashReset();
+    MovieStop();
 
-        // ---------------------------------------------------------
-        // Compress the REU RAM data using 'high' compression ratio...
-        // ---------------------------------------------------------
-        int max_len = lzav_compress_bound_hi(256*1024);
-        int comp_len = lzav_compress_hi(REU_RAM, CompressBuffer, 256*1024, max_len);
+    // Then, if there is an older record to go to, put back the pages the newest one saved
+    if (rewind_count > 1)
+    {
+        RewindHeader *hdr = rewind_unpack((rewind_first + rewind_count - 1) % REWIND_MAX_RECORDS);
+        uint8 *p = rewind_pages(hdr);
+        for (int i=0; i<hdr->num_pages; i++)
+        {
+            int page = *p++;
+            memcpy(RAM + (page << 8), p, 256);
+            memcpy(rewind_shadow + (page << 8), p, 256);
+            p += 256;
+        }
+        rewind_count--;
+    }
 
-        int i = 0;
-        i += fwrite(&comp_len,        sizeof(comp_len), 1, f);
-        i += fwrite(&CompressBuffer,  comp_len,         1, f);
-        i += fwrite((void*)&state,    sizeof(state),    1, f);
+    RewindHeader *hdr = rewind_unpack((rewind_first + rewind_count - 1) % REWIND_MAX_RECORDS);
 
-        return (i == 3) ? true:false;
+    // Drive or SID configuration changed under us - the ring no longer applies
+    if (((hdr->flags & SNAPSHOT_1541) != 0) != TheDrivePrefs.TrueDrive || hdr->sid2 != myConfig.sid2Addr)
+    {
+        RewindReset();
+        return false;
     }
-    else
+
+    uint8 *p = rewind_work + sizeof(RewindHeader);
+    if (hdr->flags & SNAPSHOT_1541)
     {
-        return true;
+        memcpy(&rewind_1541, p, sizeof(rewind_1541));   p += sizeof(rewind_1541);
+        memcpy(RAM1541, p, DRIVE_RAM_SIZE);             p += DRIVE_RAM_SIZE;
+        TheCPU1541->SetState(&rewind_1541.cpu);
+        TheJob1541->SetState(&rewind_1541.job);
     }
+    memcpy(Color, p, 0x400);
+
+    TheVIC->SetState(&hdr->vic);
+    TheSID->SetState(&hdr->sid[0]);
+    TheSID2->SetState(&hdr->sid[1]);
+    TheCIA1->SetState(&hdr->cia[0]);
+    TheCIA2->SetState(&hdr->cia[1]);
+    TheCPU->SetState(&hdr->cpu);
+    TheCart->SetState(&hdr->cart);
+
+    rewind_frames = REWIND_FRAMES;
+    return true;
 }
 
+
 /*
- *  Load REU state from snapshot
+ *  State hash: with the STATE HASH option on, every frame gets a CRC32 of the
+ *  CPU, VIC, CIA and SID state, color RAM, the RAM pages written during the
+ *  frame and - with True Drive - the 1541 processor and its RAM. The hashes go
+ *  into a ring that can be written out as text. Two builds run on the same
+ *  input from the same reset or snapshot should give the same list; the first
+ *  line that differs is the frame where they went their separate ways.
  */
 
-bool C64::LoadREUState(FILE *f)
+#define STATE_HASH_FRAMES   4096        // Last 80 seconds or so
+
+static uint32 *state_hash_ring = NULL;
+static uint32 state_hash_frame = 0;     // Frames hashed since the last reset, snapshot load or rewind
+
+void C64::StateHashReset(void)
 {
-    REUState state;
+    state_hash_frame = 0;
+    memset(hash_dirty, 0x01, sizeof(hash_dirty));   // All of RAM may be new - hash the lot
+}
 
-    if (myConfig.reuType)
+void C64::StateHash(void)
+{
+    // Static so the padding stays zero (and off the small DTCM stack)
+    static MOS6510State cpu;
+    static MOS6569State vic;
+    static MOS6581State sid[2];
+    static MOS6526State cia[2];
+    static MOS6502State cpu1541;
+
+    if (state_hash_ring == NULL)
     {
-        int comp_len = 0;
-        int i = 0;
-        i += fread(&comp_len,       sizeof(comp_len), 1, f);
-        i += fread(CompressBuffer,  comp_len,         1, f);
-        i += fread((void*)&state,   sizeof(state),    1, f);
-
-        if (i == 3)
-        {
-            // ---------------------------------------------------------------------
-            // Decompress the previously compressed REU_RAM and put it back into the
-            // right memory location... this is quite fast all things considered.
-            // ---------------------------------------------------------------------
-            (void)lzav_decompress( CompressBuffer, REU_RAM, comp_len, 256*1024 );
+        state_hash_ring = (uint32 *)malloc(STATE_HASH_FRAMES * sizeof(uint32));
+        if (state_hash_ring == NULL) return;
+    }
 
-            TheREU->SetState(&state);
-            return true;
-        }
-        else
-        { iprintf("LoadREUState Failed"); return false;}
+    TheCPU->GetState(&cpu);
+    TheVIC->GetState(&vic);
+    TheCIA1->GetState(&cia[0]);
+    TheCIA2->GetState(&cia[1]);
+    TheSID->GetState(&sid[0]);
+    TheSID2->GetState(&sid[1]);
+
+    uint32 crc = 0xFFFFFFFF;
+    crc = updateCRC32(crc, (u8*)&cpu, sizeof(cpu));
+    crc = updateCRC32(crc, (u8*)&vic, sizeof(vic));
+    crc = updateCRC32(crc, (u8*)cia, sizeof(cia));
+    crc = updateCRC32(crc, (u8*)sid, myConfig.sid2Addr ? sizeof(sid) : sizeof(sid[0]));
+    crc = updateCRC32(crc, Color, COLOR_RAM_SIZE);
+
+    collect_dirty_pages();
+    for (int page=0; page<256; page++)
+    {
+        if (!hash_dirty[page]) continue;
+        uint8 page_num = page;
+        crc = updateCRC32(crc, &page_num, 1);
+        crc = updateCRC32(crc, RAM + (page << 8), 256);
     }
-    else
+    memset(hash_dirty, 0x00, sizeof(hash_dirty));
+
+    if (TheDrivePrefs.TrueDrive)
     {
-        return true;
+        TheCPU1541->GetState(&cpu1541);
+        crc = updateCRC32(crc, (u8*)&cpu1541, sizeof(cpu1541));
+        crc = updateCRC32(crc, RAM1541, DRIVE_RAM_SIZE);
     }
+
+    state_hash_ring[state_hash_frame % STATE_HASH_FRAMES] = ~crc;
+    state_hash_frame++;
 }
 
+// Write the ring out as "frame crc" lines, oldest first
+bool C64::StateHashDump(char *filename)
+{
+    if (state_hash_ring == NULL || state_hash_frame == 0) return false;
 
-/*
- *  Save 1541 GCR state to snapshot
- */
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) return false;
 
-bool C64::Save1541JobState(FILE *f)
-{
-    Job1541State state;
-    TheJob1541->GetState(&state);
-    return fwrite((void*)&state, sizeof(state), 1, f) == 1;
+    uint32 first = (state_hash_frame > STATE_HASH_FRAMES) ? (state_hash_frame - STATE_HASH_FRAMES) : 0;
+    for (uint32 frame=first; frame<state_hash_frame; frame++)
+    {
+        fprintf(f, "%06u %08X\n", (unsigned)frame, (unsigned)state_hash_ring[frame % STATE_HASH_FRAMES]);
+    }
+    return (fclose(f) == 0);
 }
 
 
 /*
- *  Load 1541 GCR state from snapshot
+ *  Movies: a snapshot to start from, followed by everything the player fed in
+ *  from then on - the keyboard matrix and joysticks whenever they change, text
+ *  typed into the keyboard buffer, and disk swaps and resets made from the
+ *  menus. Each event carries the number of frames since the one before it.
+ *  Playing a movie back feeds it all in again at exactly the same frames, so it
+ *  makes a repeatable workload for regression runs (with STATE HASH on, the two
+ *  .hsh dumps should match) and for benchmarks: play it with warp on and the
+ *  frame rate reached is shown at the end and added to bench.txt.
  */
 
-bool C64::Load1541JobState(FILE *f)
+#define MOVIE_HEADER    "GimliMovie"
+#define MOVIE_VERSION   1
+#define MOVIE_INPUT_LEN 18
+
+enum {
+    MOVIE_NOP,      // Nothing - spans a gap of more than 65535 frames
+    MOVIE_INPUT,    // KeyMatrix[8], RevMatrix[8], Joystick1, Joystick2
+    MOVIE_TEXT,     // Length byte and the characters fed to the keyboard buffer
+    MOVIE_DISK,     // MOVIE_DISK_xxx flags, then the drive 8 and 9 paths (length byte + characters)
+    MOVIE_RESET,    // System reset from the main menu
+    MOVIE_END
+};
+
+#define MOVIE_DISK_TRUE_DRIVE   0x01
+#define MOVIE_DISK_RESET        0x02
+
+extern void kbd_buf_feed(const char *s);
+extern void kbd_buf_reset(void);
+
+uint8 movie_mode = MOVIE_OFF;
+static FILE  *movie_file = NULL;            // Movie being recorded
+static uint8 *movie_buf = NULL;             // Events of the movie being played
+static int    movie_len, movie_pos;
+static uint32 movie_frame;                  // Frames since the movie started
+static uint32 movie_event_frame;            // Frame of the last event written or played
+static uint8  movie_input[MOVIE_INPUT_LEN]; // Keyboard matrix and joysticks as last written or played
+static uint8  movie_feeding = 0;            // Set while the movie types its own text
+static uint32 movie_vblanks;                // DS frames when playback started
+static char   movie_path[MAX_FILENAME_LEN];
+
+static void movie_put_event(uint8 type, const uint8 *data, int len)
 {
-    Job1541State state;
+    uint32 delta = movie_frame - movie_event_frame;
+    uint8 hdr[3];
 
-    if (fread((void*)&state, sizeof(state), 1, f) == 1)
+    while (delta > 0xFFFF)
     {
-        TheJob1541->SetState(&state);
-        return true;
-    } else { iprintf("Load1541JobState\n"); return false;}
+        hdr[0] = 0xFF; hdr[1] = 0xFF; hdr[2] = MOVIE_NOP;
+        fwrite(hdr, sizeof(hdr), 1, movie_file);
+        delta -= 0xFFFF;
+    }
+    hdr[0] = delta & 0xFF; hdr[1] = delta >> 8; hdr[2] = type;
+    fwrite(hdr, sizeof(hdr), 1, movie_file);
+    if (len) fwrite(data, len, 1, movie_file);
+    movie_event_frame = movie_frame;
 }
 
+// Append a length-prefixed string to an event payload
+static int movie_put_string(uint8 *p, const char *s)
+{
+    int len = strlen(s);
+    if (len > 255) len = 255;
+    *p = len;
+    memcpy(p + 1, s, len);
+    return len + 1;
+}
 
-#define SNAPSHOT_HEADER  "GimliSnapshot"
-#define SNAPSHOT_1541    1
-
-/*
- *  Save snapshot (emulation must be paused and in VBlank)
- *
- *  To be able to use SC snapshots with SL, SC snapshots are made thus that no
- *  partially dealt with instructions are saved. Instead all devices are advanced
- *  cycle by cycle until the current instruction has been finished. The number of
- *  cycles this takes is saved in the snapshot and will be reconstructed if the
- *  snapshot is loaded into FrodoSC again.
- */
+// Fetch a length-prefixed string from the events being played; false if it runs off the end
+static bool movie_get_string(char *s)
+{
+    if (movie_pos >= movie_len) return false;
+    int len = movie_buf[movie_pos++];
+    if (movie_pos + len > movie_len) return false;
+    memcpy(s, movie_buf + movie_pos, len);
+    s[len] = 0;
+    movie_pos += len;
+    return true;
+}
 
-bool C64::SaveSnapshot(char *filename)
+bool C64::MovieRecord(char *filename)
 {
-    FILE *f;
-    uint8 flags;
+    MovieStop();
 
-    if (strlen(filename) < 5) return false;
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) return false;
 
-    if ((f = fopen(filename, "wb")) == NULL)
+    kbd_buf_reset();
+    fprintf(f, "%s%c%c", MOVIE_HEADER, 10, MOVIE_VERSION);
+    if (!save_snapshot(f))
     {
-        //ShowRequester("Unable to open snapshot file", "OK", NULL);
+        fclose(f);
+        remove(filename);
         return false;
     }
 
-    fprintf(f, "%s%c", SNAPSHOT_HEADER, 10);
-    fputc(SNAPSHOT_VERSION, f); // Version number
-    flags = 0;
-    if (TheDrivePrefs.TrueDrive) flags |= SNAPSHOT_1541;
-    fputc(flags, f);
-    bool bVICSave  = SaveVICState(f);
-    bool bSIDSave  = SaveSIDState(f);
-    bool bCIASave  = SaveCIAState(f);
-    bool bCPUSave  = SaveCPUState(f);
-    bool bCARTSave = SaveCARTState(f);
-    bool bREUSave  = SaveREUState(f);
-    fputc(0, f);        // No delay
+    movie_file = f;
+    movie_frame = movie_event_frame = 0;
+    memset(movie_input, 0xFF, sizeof(movie_input));
+    strcpy(movie_path, filename);
+    movie_mode = MOVIE_RECORDING;
+    return true;
+}
 
-    if (TheDrivePrefs.TrueDrive)
+bool C64::MoviePlay(char *filename)
+{
+    MovieStop();
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) return false;
+
+    char Header[] = MOVIE_HEADER;
+    char *b = Header;
+    while (*b) {
+        if (fgetc(f) != *b++) {
+            b = NULL;
+            break;
+        }
+    }
+    if ((b == NULL) || (fgetc(f) != 10) || (fgetc(f) != MOVIE_VERSION) || !load_snapshot(f))
     {
-        fwrite(TheDrivePrefs.DrivePath[0], 256, 1, f);
-        Save1541State(f);
-        fputc(0, f);    // No delay
-        Save1541JobState(f);
+        fclose(f);
+        return false;
     }
+
+    // The snapshot leaves the file at the first event - the rest is small enough to hold
+    long start = ftell(f);
+    fseek(f, 0, SEEK_END);
+    movie_len = ftell(f) - start;
+    fseek(f, start, SEEK_SET);
+    movie_buf = (uint8*)malloc(movie_len > 0 ? movie_len : 1);
+    bool ok = (movie_buf != NULL) && (fread(movie_buf, movie_len, 1, f) == 1);
     fclose(f);
+    if (!ok)
+    {
+        if (movie_buf) free(movie_buf);
+        movie_buf = NULL;
+        return false;
+    }
 
-    if (bVICSave && bSIDSave && bCIASave && bCPUSave && bCARTSave && bREUSave) return true;
-    return false;
+    kbd_buf_reset();
+    movie_pos = 0;
+    movie_frame = movie_event_frame = 0;
+    memset(movie_input, 0xFF, sizeof(movie_input));
+    strcpy(movie_path, filename);
+    extern u32 vblank_count;
+    movie_vblanks = vblank_count;
+    movie_mode = MOVIE_PLAYING;
+    return true;
+}
+
+void C64::MovieStop(void)
+{
+    if (movie_mode == MOVIE_RECORDING)
+    {
+        movie_put_event(MOVIE_END, NULL, 0);
+        fclose(movie_file);
+        movie_file = NULL;
+    }
+    else if (movie_mode == MOVIE_PLAYING)
+    {
+        free(movie_buf);
+        movie_buf = NULL;
+
+        // Report how fast it went - the DS refreshes at 59.83 Hz
+        extern u32 vblank_count;
+        uint32 vblanks = vblank_count - movie_vblanks;
+        uint32 fps = vblanks ? (uint32)(((u64)movie_frame * 5983) / ((u64)vblanks * 100)) : 0;
+        char tmp[16];
+        sprintf(tmp, "%4d FPS ", (int)fps);
+        DSPrint(23, 0, 0, tmp);
+        save_msg_frames = 200;
+
+        FILE *f = fopen("bench.txt", "a");
+        if (f != NULL)
+        {
+            fprintf(f, "%s %u frames %u vblanks %u fps\n", movie_path, (unsigned)movie_frame, (unsigned)vblanks, (unsigned)fps);
+            fclose(f);
+        }
+    }
+    movie_mode = MOVIE_OFF;
 }
 
+// A disk swap made from the menu while recording - the NewPrefs() and optional reset are played back as-is
+void C64::MovieDiskSwap(bool reset)
+{
+    if (movie_mode != MOVIE_RECORDING) return;
+
+    static uint8 payload[1 + 2*256];
+    int len = 0;
+    payload[len++] = (TheDrivePrefs.TrueDrive ? MOVIE_DISK_TRUE_DRIVE : 0) | (reset ? MOVIE_DISK_RESET : 0);
+    len += movie_put_string(payload + len, TheDrivePrefs.DrivePath[0]);
+    len += movie_put_string(payload + len, TheDrivePrefs.DrivePath[1]);
+    movie_put_event(MOVIE_DISK, payload, len);
+}
 
-/*
- *  Load snapshot (emulation must be paused and in VBlank)
- */
+void C64::MovieReset(void)
+{
+    if (movie_mode == MOVIE_RECORDING) movie_put_event(MOVIE_RESET, NULL, 0);
+}
 
-bool C64::LoadSnapshot(char *filename)
+static void movie_text(const char *s)
 {
-    uint8 delay;
-    FILE *f;
+    uint8 payload[256];
+    movie_put_event(MOVIE_TEXT, payload, movie_put_string(payload, s));
+}
 
-    if ((f = fopen(filename, "rb")) != NULL) {
-        char Header[] = SNAPSHOT_HEADER;
-        char *b = Header, c = 0;
-
-        // For some reason memcmp()/strcmp() and so forth utterly fail here.
-        while (*b > 32) {
-            if ((c = fgetc(f)) != *b++) {
-                b = NULL;
-                break;
-            }
-        }
-        if (b != NULL) {
-            uint8 flags;
-            bool error = false;
-            long vicptr;    // File offset of VIC data
-
-            while (c != 10)
-                c = fgetc(f);   // Shouldn't be necessary
-            if (fgetc(f) != SNAPSHOT_VERSION) {
-                fclose(f);
-                return false;
-            }
-            flags = fgetc(f);
-            vicptr = ftell(f);
+// Called from VBlank once the keyboard and joysticks have been polled
+static void update_movie(C64 *the_c64)
+{
+    MOS6526_1 *cia = the_c64->TheCIA1;
+    uint8 input[MOVIE_INPUT_LEN];
 
-            error |= !LoadVICState(f);
-            error |= !LoadSIDState(f);
-            error |= !LoadCIAState(f);
-            error |= !LoadCPUState(f);
-            error |= !LoadCARTState(f);
-            error |= !LoadREUState(f);
+    if (movie_mode == MOVIE_RECORDING)
+    {
+        memcpy(input, cia->KeyMatrix, 8);
+        memcpy(input + 8, cia->RevMatrix, 8);
+        input[16] = cia->Joystick1;
+        input[17] = cia->Joystick2;
+        if (memcmp(input, movie_input, sizeof(input)))
+        {
+            memcpy(movie_input, input, sizeof(input));
+            movie_put_event(MOVIE_INPUT, input, sizeof(input));
+        }
+        movie_frame++;
+    }
+    else if (movie_mode == MOVIE_PLAYING)
+    {
+        static char path8[256], path9[256];
+        bool done = false;
 
-            delay = fgetc(f);   // Number of cycles the 6510 is ahead of the previous chips
-            (void)delay;
+        // Everything due on this frame, in the order it was recorded
+        while (!done && (movie_pos + 3 <= movie_len))
+        {
+            uint32 due = movie_event_frame + (movie_buf[movie_pos] | (movie_buf[movie_pos+1] << 8));
+            if (due > movie_frame) break;
+            uint8 type = movie_buf[movie_pos+2];
+            movie_event_frame = due;
+            movie_pos += 3;
 
-            if ((flags & SNAPSHOT_1541) != 0)
+            switch (type)
             {
-                DrivePrefs *prefs = new DrivePrefs(TheDrivePrefs);
+                case MOVIE_NOP:
+                    break;
 
-                // First switch on emulation
-                int k=fread(prefs->DrivePath[0], 256, 1, f);
-                if (k==1)
-                {
-                    error |=0;
-                }
-                else
+                case MOVIE_INPUT:
+                    if (movie_pos + MOVIE_INPUT_LEN > movie_len) {done = true; break;}
+                    memcpy(movie_input, movie_buf + movie_pos, MOVIE_INPUT_LEN);
+                    movie_pos += MOVIE_INPUT_LEN;
+                    break;
+
+                case MOVIE_TEXT:
+                    if (!movie_get_string(path8)) {done = true; break;}
+                    movie_feeding = 1;
+                    kbd_buf_feed(path8);
+                    movie_feeding = 0;
+                    break;
+
+                case MOVIE_DISK:
                 {
-                    error |=1;
-                    iprintf("flags & SNAPSHOT_1541\n");
+                    if (movie_pos >= movie_len) {done = true; break;}
+                    uint8 flags = movie_buf[movie_pos++];
+                    if (!movie_get_string(path8) || !movie_get_string(path9)) {done = true; break;}
+
+                    kbd_buf_reset();
+                    DrivePrefs *prefs = new DrivePrefs(TheDrivePrefs);
+                    strcpy(prefs->DrivePath[0], path8);
+                    strcpy(prefs->DrivePath[1], path9);
+                    prefs->TrueDrive = (flags & MOVIE_DISK_TRUE_DRIVE) ? true : false;
+                    the_c64->NewPrefs(prefs);
+                    TheDrivePrefs = *prefs;
+                    delete prefs;
+                    strcpy(Drive8File, path8);
+                    strcpy(Drive9File, path9);
+                    if (!(flags & MOVIE_DISK_RESET)) break;
                 }
-                prefs->TrueDrive = true;
-                NewPrefs(prefs);
-                TheDrivePrefs = *prefs;
-                delete prefs;
-
-                // Then read the context
-                error |= !Load1541State(f);
-
-                delay = fgetc(f);   // Number of cycles the 6502 is ahead of the previous chips
-                Load1541JobState(f);
-            } else if (TheDrivePrefs.TrueDrive) {    // No emulation in snapshot, but currently active?
-                DrivePrefs *prefs = new DrivePrefs(TheDrivePrefs);
-                prefs->TrueDrive = false;
-                NewPrefs(prefs);
-                TheDrivePrefs = *prefs;
-                delete prefs;
+                // Fall through - the swap asked for a reset
+                case MOVIE_RESET:
+                    the_c64->RemoveCart();
+                    the_c64->PatchKernal(TheDrivePrefs.TrueDrive);
+                    the_c64->Reset();
+                    break;
+
+                default:    // MOVIE_END or something we don't know
+                    done = true;
+                    break;
             }
+        }
 
-            fseek(f, vicptr, SEEK_SET);
-            LoadVICState(f);    // Load VIC data twice in SL (is REALLY necessary sometimes!)
-            fclose(f);
+        memcpy(cia->KeyMatrix, movie_input, 8);
+        memcpy(cia->RevMatrix, movie_input + 8, 8);
+        cia->Joystick1 = movie_input[16];
+        cia->Joystick2 = movie_input[17];
+        movie_frame++;
 
-            if (error) {
-                Reset();
-                return false;
-            } else
-                return true;
-        } else {
-            fclose(f);
-            return false;
-        }
-    } else {
-        return false;
+        if (done || (movie_pos + 3 > movie_len)) the_c64->MovieStop();
     }
 }
 
@@ -1003,6 +2383,8 @@ char kbd_feedbuf[256];
 int kbd_feedbuf_pos;
 
 void kbd_buf_feed(const char *s) {
+    if (movie_mode == MOVIE_PLAYING && !movie_feeding) return; // The movie types its own
+    if (movie_mode == MOVIE_RECORDING) movie_text(s);
     strncat(kbd_feedbuf, s, 255);
 }
 
@@ -1018,6 +2400,7 @@ void kbd_buf_update(C64 *TheC64)
     {
         TheC64->RAM[631]=kbd_feedbuf[kbd_feedbuf_pos];
         TheC64->RAM[198]=1;
+        ram_page_dirty[631 >> 8] = 1;
         kbd_feedbuf_pos++;
     }
     else
@@ -1031,6 +2414,99 @@ void kbd_buf_update(C64 *TheC64)
 }
 
 
+/*
+ *  Auto-warp: run flat out while the disk drive is busy. Any button, touch or
+ *  C64 key puts us straight back to real time - as does SID music unless the
+ *  sound is muted while warping.
+ */
+static void update_auto_warp(C64 *the_c64)
+{
+    uint8 warp = 0;
+
+    if (myGlobalConfig.autoWarp && drive_activity && !bTurboWarp)
+    {
+        warp = 1;
+
+        if (keysHeld()) warp = 0;
+
+        for (int i=0; i<8; i++)
+        {
+            if (the_c64->TheCIA1->KeyMatrix[i] != 0xff) warp = 0;
+        }
+
+        // Any voice gated means music or effects are playing - that must run in real time
+        if ((myGlobalConfig.autoWarp == 1) && ((regs[4] | regs[11] | regs[18]) & 0x01)) warp = 0;
+    }
+
+    if (warp != bAutoWarp)
+    {
+        if (myGlobalConfig.autoWarp == 2)
+        {
+            if (warp) the_c64->TheSID->PauseSound();
+            else the_c64->TheSID->ResumeSound();
+        }
+        bAutoWarp = warp;
+    }
+}
+
+
+/*
+ *  Rewind: while the mapped key is held, step back one record every few
+ *  frames - otherwise keep capturing as long as some key is mapped to it.
+ */
+static uint8 rewind_key = 0;    // Set by poll_joystick() while a REWIND key is held
+
+static void update_rewind(C64 *the_c64)
+{
+    static u8 rewind_dampen = 0;
+
+    if (rewind_key)
+    {
+        if (rewind_dampen) rewind_dampen--;
+        else
+        {
+            the_c64->RewindStep();
+            rewind_dampen = 8;
+        }
+        rewind_frames = REWIND_FRAMES;
+        return;
+    }
+    rewind_dampen = 0;
+
+    for (int i=0; i<(int)sizeof(myConfig.key_map); i++)
+    {
+        if (myConfig.key_map[i] == KEY_MAP_REWIND)
+        {
+            if (--rewind_frames <= 0) the_c64->RewindCapture();
+            break;
+        }
+    }
+}
+
+
+/*
+ *  Quick-save keys: act once per press on the current quick slot
+ */
+static uint8 quick_key = 0;     // KEY_MAP_QUICK_SAVE/LOAD while such a key is held
+
+static void update_quick_slots(C64 *the_c64)
+{
+    static u8 last_quick_key = 0;
+    char tmp[12];
+
+    if (quick_key && quick_key != last_quick_key)
+    {
+        bool ok;
+        if (quick_key == KEY_MAP_QUICK_SAVE) ok = the_c64->QuickSave(quick_slot);
+        else ok = the_c64->QuickLoad(quick_slot);
+        sprintf(tmp, "%s %d ", ok ? ((quick_key == KEY_MAP_QUICK_SAVE) ? "QSAVE":"QLOAD") : "EMPTY", quick_slot+1);
+        DSPrint(23, 0, 0, tmp);
+        save_msg_frames = 100;
+    }
+    last_quick_key = quick_key;
+}
+
+
 /*
  *  Vertical blank: Poll keyboard and joysticks, update window
  */
@@ -1041,19 +2517,40 @@ ITCM_CODE void C64::VBlank(bool draw_frame)
     static int frames=0;
     static int frames_per_sec=0;
 
+    if (bRunAhead) return;  // A frame ahead - input, timers and the sync all belong to the real one
+
+    if (boot_capture_frames) boot_capture();    // Still booting - see if it is at READY. yet
+
+    if (myGlobalConfig.stateHash) StateHash();  // Before this frame's input goes in
+
     scanKeys();
-    kbd_buf_update(this);
+    rewind_key = 0;
+    quick_key = 0;
 
     TheDisplay->PollKeyboard(TheCIA1->KeyMatrix, TheCIA1->RevMatrix, &joykey);
 
     TheCIA1->Joystick1 = poll_joystick(0);
     TheCIA1->Joystick2 = poll_joystick(1);
 
+    // After the movie has had its say, so text it plays goes in on the frame it was recorded
+    update_movie(this);
+    kbd_buf_update(this);
+
     TheCIA1->CountTOD();
     TheCIA2->CountTOD();
 
     TheCart->CartFrame();
 
+    update_auto_warp(this);
+    update_rewind(this);
+    update_quick_slots(this);
+    SaveSnapshotSlice();
+
+    // Anything touching the drive, the REU or cartridge flash has effects we cannot take back
+    run_ahead_pending = myGlobalConfig.runAhead && isDSiMode() && draw_frame && !TheDrivePrefs.TrueDrive && !myConfig.reuType &&
+                        !flash_write_supported && !drive_activity && !bAutoWarp && !bTurboWarp && !rewind_key;
+    if (!run_ahead_pending) run_ahead_ticks = 0;
+
     frames++;
 
     // ----------------------------------------------------------------------------------
@@ -1062,7 +2559,7 @@ ITCM_CODE void C64::VBlank(bool draw_frame)
     extern volatile u16 DSIvBlanks;
     while (last_sync_frames == DSIvBlanks)
     {
-        if (bTurboWarp) break;
+        if (bTurboWarp || bAutoWarp) break;
     }
     last_sync_frames = DSIvBlanks;
 
@@ -1289,6 +2786,15 @@ uint8 C64::poll_joystick(int port)
                     zoom_dampen = 50;
                     break;
 
+                case KEY_MAP_REWIND:
+                    rewind_key = 1;
+                    break;
+
+                case KEY_MAP_QUICK_SAVE:
+                case KEY_MAP_QUICK_LOAD:
+                    quick_key = myConfig.key_map[i];
+                    break;
+
                 // Handle all other keypresses... mark the key as pressed for the PollKeyboard() routine
                 default:
                     TheDisplay->IssueKeypress(key_row_map[myConfig.key_map[i]-8], key_col_map[myConfig.key_map[i]-8], TheCIA1->KeyMatrix, TheCIA1->RevMatrix);
@@ -1479,6 +2985,49 @@ int C64::CIA_Delta(void)
     return retVal;
 }
 
+/*
+ *  Emulate one raster line of the whole machine
+ */
+
+inline void C64::emulate_line(void)
+{
+    // The order of calls is important here
+    int cpu_cycles_to_execute = TheVIC->EmulateLine();
+    TheSID->EmulateLine(SID_CYCLES_PER_LINE_PAL);
+    if (myConfig.sid2Addr) TheSID2->EmulateLine(SID_CYCLES_PER_LINE_PAL);
+    TheCIA1->EmulateLine(CIA_CYCLES_PER_LINE_PAL + CIA_Delta());
+    TheCIA2->EmulateLine(CIA_CYCLES_PER_LINE_PAL + CIA_Delta());
+
+    // -----------------------------------------------------------------
+    // TrueDrive is more complicated as we must interleave the two CPUs
+    // -----------------------------------------------------------------
+    if (TheDrivePrefs.TrueDrive)
+    {
+        int cycles_1541 = FLOPPY_CYCLES_PER_LINE + CycleDeltas[myConfig.flopCycles] + CycleDeltas[myConfig.cpuCycles];
+        TheCPU1541->CountVIATimers(cycles_1541);
+
+        if (!TheCPU1541->Idle)
+        {
+            // -----------------------------------------------------------
+            // 1541 processor active, alternately execute 6502 and 6510
+            // instructions until both have used up their cycles. This
+            // is now handled inside CPU_emuline.h for the 1541 processor
+            // to avoid the overhead of lots of function calls...
+            // -----------------------------------------------------------
+            TheCPU1541->EmulateLine(cycles_1541, cpu_cycles_to_execute);
+        }
+        else
+        {
+            TheCPU->EmulateLine(cpu_cycles_to_execute);
+        }
+    }
+    else
+    {
+        // 1541 processor disabled, only emulate 6510
+        TheCPU->EmulateLine(cpu_cycles_to_execute);
+    }
+}
+
 /*
  * The emulation's main loop
  */
@@ -1493,46 +3042,96 @@ void C64::main_loop(void)
             continue;
         }
 
-        // The order of calls is important here
-        int cpu_cycles_to_execute = TheVIC->EmulateLine();
-        TheSID->EmulateLine(SID_CYCLES_PER_LINE_PAL);
-        TheCIA1->EmulateLine(CIA_CYCLES_PER_LINE_PAL + CIA_Delta());
-        TheCIA2->EmulateLine(CIA_CYCLES_PER_LINE_PAL + CIA_Delta());
+        if (run_ahead_pending) run_ahead();
 
-        // -----------------------------------------------------------------
-        // TrueDrive is more complicated as we must interleave the two CPUs
-        // -----------------------------------------------------------------
-        if (TheDrivePrefs.TrueDrive)
-        {
-            int cycles_1541 = FLOPPY_CYCLES_PER_LINE + CycleDeltas[myConfig.flopCycles] + CycleDeltas[myConfig.cpuCycles];
-            TheCPU1541->CountVIATimers(cycles_1541);
+        emulate_line();
+    }
+}
 
-            if (!TheCPU1541->Idle)
-            {
-                // -----------------------------------------------------------
-                // 1541 processor active, alternately execute 6502 and 6510
-                // instructions until both have used up their cycles. This
-                // is now handled inside CPU_emuline.h for the 1541 processor
-                // to avoid the overhead of lots of function calls...
-                // -----------------------------------------------------------
-                TheCPU1541->EmulateLine(cycles_1541, cpu_cycles_to_execute);
-            }
-            else
-            {
-                TheCPU->EmulateLine(cpu_cycles_to_execute);
-            }
+/*
+ *  Run the frames ahead from just after VBlank and come back (see above)
+ */
+
+void C64::run_ahead(void)
+{
+    uint32 start = GetTicks();
+    run_ahead_pending = 0;
+
+    if (run_ahead_shadow == NULL)
+    {
+        run_ahead_shadow = (uint8 *)malloc(C64_RAM_SIZE);
+        if (run_ahead_shadow == NULL) return;
+        run_ahead_synced = 0;
+    }
+
+    // Bring the shadow up to date with what the real frames wrote
+    collect_dirty_pages();
+    if (!run_ahead_synced)
+    {
+        memcpy(run_ahead_shadow, RAM, C64_RAM_SIZE);
+        run_ahead_synced = 1;
+    }
+    else
+    {
+        for (int page=0; page<256; page++)
+        {
+            if (run_ahead_dirty[page]) memcpy(run_ahead_shadow + (page << 8), RAM + (page << 8), 256);
         }
-        else
+    }
+    memset(run_ahead_dirty, 0x00, sizeof(run_ahead_dirty));
+    memcpy(run_ahead_color, Color, COLOR_RAM_SIZE);
+
+    TheCPU->GetState(&run_ahead_state.cpu);
+    TheVIC->GetState(&run_ahead_state.vic);
+    TheSID->GetState(&run_ahead_state.sid[0]);
+    TheSID2->GetState(&run_ahead_state.sid[1]);
+    TheCIA1->GetState(&run_ahead_state.cia[0]);
+    TheCIA2->GetState(&run_ahead_state.cia[1]);
+    TheCart->GetState(&run_ahead_state.cart);
+
+    // Only the last frame ahead is drawn
+    bRunAhead = 1;
+    run_ahead_abort = 0;
+    for (int frame=myGlobalConfig.runAhead; frame && !run_ahead_abort; frame--)
+    {
+        TheVIC->SkipFrame(frame != 1);
+        for (int line=0; line<TOTAL_RASTERS_PAL && !run_ahead_abort; line++)
         {
-            // 1541 processor disabled, only emulate 6510
-            TheCPU->EmulateLine(cpu_cycles_to_execute);
+            emulate_line();
         }
     }
+
+    // And back to where we were - the SID renderer never heard any of it. What the
+    // frames ahead wrote is still in ram_page_dirty (their VBlanks collect nothing).
+    ram_page_dirty[0] = ram_page_dirty[1] = 1;
+    for (int page=0; page<256; page++)
+    {
+        if (ram_page_dirty[page]) memcpy(RAM + (page << 8), run_ahead_shadow + (page << 8), 256);
+    }
+    memset(ram_page_dirty, 0x00, sizeof(ram_page_dirty));
+    memcpy(Color, run_ahead_color, COLOR_RAM_SIZE);
+
+    TheVIC->SetState(&run_ahead_state.vic);
+    TheSID->SetState(&run_ahead_state.sid[0]);
+    TheSID2->SetState(&run_ahead_state.sid[1]);
+    TheCIA1->SetState(&run_ahead_state.cia[0]);
+    TheCIA2->SetState(&run_ahead_state.cia[1]);
+    TheCPU->SetState(&run_ahead_state.cpu);
+    TheCart->SetState(&run_ahead_state.cart);
+    bRunAhead = 0;
+
+    // The real frame is drawn only if the frames ahead had to be given up
+    TheVIC->SkipFrame(!run_ahead_abort);
+    run_ahead_ticks = GetTicks() - start;
 }
 
 void C64::Pause() {
     have_a_break=true;
+    run_ahead_synced=0;     // The menus may load or poke at RAM behind our back
+    bAutoWarp=0;            // Sound is paused here anyway - the next frame decides afresh
     TheSID->PauseSound();
+    TheJob1541->FlushTracks();  // Anything the drive wrote goes to the image before we enter the menus
+    TheIEC->Flush();
 }
 
 void C64::Resume() {
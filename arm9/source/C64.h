@@ -62,6 +62,26 @@ class Job1541;
 class Cartridge;
 class CmdPipe;
 class REU;
+struct SnapshotChunk;
+
+// Snapshot metadata - the first chunks of a .GSS file, also copied to the
+// index file next to it so a menu can show them without opening the snapshot
+#define SNAPSHOT_THUMB_W    80      // Every 4th pixel of the 320x200 display window
+#define SNAPSHOT_THUMB_H    50
+#define SNAPSHOT_THUMB_SIZE (SNAPSHOT_THUMB_W * SNAPSHOT_THUMB_H)
+
+// movie_mode
+#define MOVIE_OFF           0
+#define MOVIE_RECORDING     1
+#define MOVIE_PLAYING       2
+
+struct SnapshotMeta {
+    char   name[64];        // Disk or cartridge file of the game
+    uint32 crc;             // CRC32 of that file
+    uint32 time;            // When the snapshot was taken (seconds since 1970)
+    uint8  true_drive;      // Taken with the 1541 processor emulation running
+    uint8  reserved[3];
+};
 
 class C64 {
 public:
@@ -81,6 +101,24 @@ public:
     void SaveRAM(char *filename);
     bool SaveSnapshot(char *filename);
     bool LoadSnapshot(char *filename);
+    bool StartSnapshotSave(char *filename);
+    bool QuickSave(int slot);
+    bool QuickLoad(int slot);
+    bool QuickPersist(int slot, char *filename);
+    void SaveSnapshotSlice(void);
+    void FinishSnapshotSave(void);
+    void RewindCapture(void);
+    bool RewindStep(void);
+    void RewindReset(void);
+    void StateHash(void);
+    void StateHashReset(void);
+    bool StateHashDump(char *filename);
+    bool MovieRecord(char *filename);
+    bool MoviePlay(char *filename);
+    void MovieStop(void);
+    void MovieDiskSwap(bool reset);
+    void MovieReset(void);
+    bool SaveMetaState(FILE *f);
     int SaveCPUState(FILE *f);
     int Save1541State(FILE *f);
     bool Save1541JobState(FILE *f);
@@ -89,14 +127,14 @@ public:
     bool SaveCIAState(FILE *f);
     bool SaveCARTState(FILE *f);
     bool SaveREUState(FILE *f);
-    bool LoadCPUState(FILE *f);
-    bool Load1541State(FILE *f);
-    bool Load1541JobState(FILE *f);
-    bool LoadVICState(FILE *f);
-    bool LoadSIDState(FILE *f);
-    bool LoadCIAState(FILE *f);
-    bool LoadCARTState(FILE *f);
-    bool LoadREUState(FILE *f);
+    bool LoadCPUState(FILE *f, SnapshotChunk *chunk);
+    bool Load1541State(FILE *f, SnapshotChunk *chunk);
+    bool Load1541JobState(FILE *f, SnapshotChunk *chunk);
+    bool LoadVICState(FILE *f, SnapshotChunk *chunk);
+    bool LoadSIDState(FILE *f, SnapshotChunk *chunk);
+    bool LoadCIAState(FILE *f, SnapshotChunk *chunk);
+    bool LoadCARTState(FILE *f, SnapshotChunk *chunk);
+    bool LoadREUState(FILE *f, SnapshotChunk *chunk);
     void InsertCart(char *filename);
     void RemoveCart(void);
     void LoadPRG(char *filename);
@@ -111,6 +149,7 @@ public:
     MOS6510 *TheCPU;            // C64
     MOS6569 *TheVIC;
     MOS6581 *TheSID;
+    MOS6581 *TheSID2;           // Optional second SID - myConfig.sid2Addr
     MOS6526_1 *TheCIA1;
     MOS6526_2 *TheCIA2;
     IEC *TheIEC;
@@ -126,6 +165,12 @@ private:
     void c64_dtor(void);
     uint8 poll_joystick(int port);
     void main_loop(void);
+    void emulate_line(void);
+    void run_ahead(void);
+    bool save_snapshot(FILE *f);
+    bool load_snapshot(FILE *f);
+    bool boot_restore(void);
+    void boot_capture(void);
 
     bool have_a_break;      // Emulation thread shall pause
 
@@ -137,6 +182,15 @@ private:
 
 extern void floppy_soundfx(u8 is_write);
 extern uint8 cart_in;
+extern uint8 bAutoWarp;
+extern uint8 ram_page_dirty[256];
+extern uint8 quick_slot;
+extern uint8 bRunAhead;
+extern uint8 run_ahead_abort;
+extern uint32 run_ahead_ticks;
+extern uint8 movie_mode;
+extern bool SnapshotIndexFind(const char *filename, SnapshotMeta *meta, uint8 *thumb);
+extern bool QuickSlotInfo(int slot, SnapshotMeta *meta, uint8 *thumb);
 extern u8 *cartROM;
 
 extern uint8 *MemMap[0x10];
@@ -361,6 +361,7 @@ void MOS6502_1541::write_byte_io(uint16 adr, uint8 byte)
             case 1:
             case 15:
                 via2_pra = byte;
+                the_job->WriteGCRByte(byte, cycle_counter);
                 break;
             case 2:
                 via2_ddrb = byte;
@@ -396,6 +397,7 @@ void MOS6502_1541::write_byte_io(uint16 adr, uint8 byte)
                 break;
             case 12:
                 via2_pcr = byte;
+                the_job->SetWriteMode((byte & 0xe0) == 0xc0, cycle_counter);   // CB2 low output = R/W head writing
                 break;
             case 13:
                 via2_ifr &= ~byte;
@@ -648,6 +650,8 @@ void MOS6502_1541::SetState(MOS6502State *s)
     via2_ifr = s->via2_ifr; via2_ier = s->via2_ier;
 
     cycle_counter = s->cycle_counter;
+
+    the_job->SetWriteMode((via2_pcr & 0xe0) == 0xc0, cycle_counter);
 }
 
 
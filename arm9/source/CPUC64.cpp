@@ -206,7 +206,20 @@ __attribute__ ((noinline)) void MOS6510::new_config(void)
  *  CIA1: DC00->DCFF (256b) mirrorred every 16 bytes (16 times)
  *  CIA2: DD00->DDFF (256b) mirrorred every 16 bytes (16 times)
  * 
+ *  An optional second SID (myConfig.sid2Addr) takes over part of the SID mirrors
+ *  or the cartridge I/O 1 area.
+ * 
  */
+static inline bool sid2_decode(uint16 adr)
+{
+    switch (myConfig.sid2Addr)
+    {
+        case SID2_D420: return (adr & 0x20);                // D420->D43F and every other 32 byte mirror
+        case SID2_D500: return ((adr & 0x300) == 0x100);    // D500->D5FF
+        default:        return false;
+    }
+}
+
 __attribute__ ((noinline)) uint8_t  MOS6510::read_byte_io(uint16 adr)
 {
     if (io_in || vic_ultimax_mode)
@@ -222,6 +235,7 @@ __attribute__ ((noinline)) uint8_t  MOS6510::read_byte_io(uint16 adr)
             case 0x5:
             case 0x6:
             case 0x7:
+                if (sid2_decode(adr)) return TheSID2->ReadRegister(adr & 0x1f);
                 return TheSID->ReadRegister(adr & 0x1f);
             case 0x8:   // Color RAM
             case 0x9:
@@ -233,6 +247,7 @@ __attribute__ ((noinline)) uint8_t  MOS6510::read_byte_io(uint16 adr)
             case 0xd:   // CIA 2
                 return TheCIA2->ReadRegister(adr & 0x0f);
             case 0xe:   // Cartridge I/O 1 (or open)
+                if (myConfig.sid2Addr == SID2_DE00) return TheSID2->ReadRegister(adr & 0x1f);
                 return TheCart->ReadIO1(adr & 0xff, rand());
             case 0xf:   // Cartridge I/O 2 (or open)
                 if (myConfig.reuType) return TheREU->ReadIO2(adr & 0xff, rand());
@@ -312,7 +327,8 @@ __attribute__ ((noinline)) void MOS6510::write_byte_io(uint16 adr, uint8 byte)
             case 0x5:
             case 0x6:
             case 0x7:
-                TheSID->WriteRegister(adr & 0x1f, byte);
+                if (sid2_decode(adr)) TheSID2->WriteRegister(adr & 0x1f, byte);
+                else TheSID->WriteRegister(adr & 0x1f, byte);
                 return;
             case 0x8:   // Color RAM
             case 0x9:
@@ -327,7 +343,8 @@ __attribute__ ((noinline)) void MOS6510::write_byte_io(uint16 adr, uint8 byte)
                 TheCIA2->WriteRegister(adr & 0x0f, byte);
                 return;
             case 0xe:   // Cartridge I/O 1 (or open)
-                TheCart->WriteIO1(adr & 0xff, byte);
+                if (myConfig.sid2Addr == SID2_DE00) TheSID2->WriteRegister(adr & 0x1f, byte);
+                else TheCart->WriteIO1(adr & 0xff, byte);
                 return;
             case 0xf:   // Cartridge I/O 2 (or open)
                 TheCart->WriteIO2(adr & 0xff, byte);
@@ -338,6 +355,7 @@ __attribute__ ((noinline)) void MOS6510::write_byte_io(uint16 adr, uint8 byte)
     else // Write through even if char_in is enabled
     {
         myRAM[adr] = byte;
+        ram_page_dirty[adr >> 8] = 1;
     }
 }
 
@@ -348,6 +366,7 @@ ITCM_CODE void MOS6510::write_byte_flash(uint16 adr, uint8 byte)
     {
         if (flash_write_supported) TheCart->WriteFlash(adr, byte);
         else myRAM[adr] = byte;
+        ram_page_dirty[adr >> 8] = 1;   // WriteFlash() may write through to RAM as well
     }
     else
     {
@@ -367,6 +386,7 @@ inline __attribute__((always_inline)) void MOS6510::write_byte(uint16 adr, uint8
     else
     {
         myRAM[adr] = byte;
+        ram_page_dirty[adr >> 8] = 1;
         if (adr < 2) new_config(); // First two bytes are special...
     }
 }
@@ -399,7 +419,7 @@ inline uint16 MOS6510::read_zp_word(uint16 adr)
 
 inline __attribute__((always_inline)) void MOS6510::write_zp(uint16 adr, uint8 byte)
 {
-    myRAM[adr] = byte;
+    myRAM[adr] = byte;  // No ram_page_dirty[] here - rewind always saves the zero page
 
     // Check if memory configuration may have changed.
     if (adr < 2) new_config(); // First two bytes are special...
@@ -560,7 +580,7 @@ void MOS6510::GetState(MOS6510State *s)
     s->spare1 = 0;
     s->spare2 = 0;
     s->spare3 = 0;
-    s->spare4 = 0;
+    s->borrowed_cycles = borrowed_cycles;
 }
 
 
@@ -594,6 +614,7 @@ void MOS6510::SetState(MOS6510State *s)
     interrupt.intr[INT_RESET] = s->intr[INT_RESET];
     nmi_state = s->nmi_state;
     dfff_byte = s->dfff_byte;
+    borrowed_cycles = s->borrowed_cycles;
 
     for (u8 i=0; i<16; i++)
     {
@@ -704,6 +725,14 @@ void MOS6510::extended_opcode(void)
     if (pc < 0xe000) {
         illegal_op(0xf2, pc-1);
     }
+
+    // A frame being run ahead must not move the drive along - it gets thrown
+    // away instead. Spin on the trap until the end of the line.
+    if (bRunAhead) {
+        run_ahead_abort = 1;
+        jump(pc-1);
+        return;
+    }
     switch (read_byte(pc++)) {
         case 0x00:
             ram[0x90] |= TheIEC->Out(ram[0x95], ram[0xa3] & 0x80);
@@ -742,6 +771,19 @@ void MOS6510::extended_opcode(void)
             TheIEC->Release();
             jump(0xedac);
             break;
+        case 0x08: {    // LOAD: copy the whole file in one go, fall back to the serial load if we can't
+            ram[0x93] = a;
+            uint16 start = ram[0xc3] | (ram[0xc4] << 8), end;
+            if (a == 0 && TheIEC->Load(ram, ram[0xba], ram[0xbb] | (ram[0xbc] << 8), ram[0xb7], ram[0xb9] != 0, start, end)) {
+                ram[0x90] = 0x40;   // EOI, as after a serial load
+                ram[0xc3] = start & 0xff; ram[0xc4] = start >> 8;
+                ram[0xae] = end & 0xff;   ram[0xaf] = end >> 8;
+                for (int page = start >> 8; page <= ((end - 1) >> 8); page++) ram_page_dirty[page] = 1;
+                jump(0xf5a9);       // CLC, LDX $AE, LDY $AF, RTS
+            } else
+                jump(0xf4a7);
+            break;
+        }
         default:
             illegal_op(0xf2, pc-1);
             break;
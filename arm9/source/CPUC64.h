@@ -86,6 +86,7 @@ public:
 
     MOS6569 *TheVIC;    // Pointer to VIC
     MOS6581 *TheSID;    // Pointer to SID
+    MOS6581 *TheSID2;   // Pointer to the optional second SID
     MOS6526_1 *TheCIA1; // Pointer to CIA 1
     MOS6526_2 *TheCIA2; // Pointer to CIA 2
     IEC *TheIEC;        // Pointer to drive array
@@ -153,7 +154,7 @@ struct MOS6510State {
     uint8 spare1;
     uint8 spare2;
     uint16 spare3;
-    uint32 spare4;
+    int32 borrowed_cycles;  // Cycles already taken from the next line (0 in older snapshots)
 };
 
 
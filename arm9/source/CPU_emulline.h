@@ -848,10 +848,29 @@
             if ((via2_pcr & 0x0e) == 0x0e && the_job->ByteReady(cycle_counter)) {    // CA2 high output and byte ready
                 v_flag = true;
             }
+            // GCR byte wait "BVC *" - skip whole turns of the loop up to the next byte
+            if (!v_flag && (via2_pcr & 0x0e) == 0x0e && read_byte(pc) == 0xfe)
+            {
+                uint32 skip = the_job->CyclesUntilByteReady(cycle_counter);
+                if (skip > (uint32)cycles_left) skip = cycles_left;
+                pc--;   // Back to the BVC
+                ENDOP(3 + (skip ? ((skip - 1) / 3) * 3 : 0));   // Last turn is the one that sees it
+            }
             Branch(!v_flag);
 #endif
 
         case 0x30:  // BMI rel
+#ifdef IS_CPU_1541
+            // ROM sync wait "BIT $1C00 : BMI *-3" - skip whole turns of the loop up to the sync
+            if ((n_flag & 0x80) && (pc >= 0xc000) && (read_byte(pc) == 0xfb) &&
+                (read_byte(pc-4) == 0x2c) && (read_byte(pc-3) == 0x00) && (read_byte(pc-2) == 0x1c))
+            {
+                uint32 skip = the_job->CyclesUntilSync(cycle_counter);
+                if (skip > (uint32)cycles_left) skip = cycles_left;
+                pc -= 4;    // Back to the BIT
+                ENDOP(3 + (skip ? ((skip - 1) / 7) * 7 : 0));   // Last turn is the one that sees it
+            }
+#endif
             Branch(n_flag & 0x80);
 
         case 0x10:  // BPL rel
@@ -1364,7 +1383,11 @@
             break;
 
         // Extension opcode - for Kernal / 1541 hooks
+#ifdef IS_CPU_1541
         case 0xf2: extended_opcode(); break;
+#else
+        case 0xf2: extended_opcode(); if (bRunAhead && !last_cycles) last_cycles = 2; break; // An aborted run-ahead spins on the trap
+#endif
         }
         
         if (page_plus_cyc) last_cycles++;
@@ -43,6 +43,7 @@
 #include "C64.h"
 #include "1541d64.h"
 #include "Cartridge.h"
+#include "SID.h"
 #include "mainmenu.h"
 #include <maxmod9.h>
 #include "soundbank.h"
@@ -69,10 +70,13 @@ uint8_t palette_blue[16] = {
 
 uint16 dimDampen = 0;
 u8 dampen_drive_led = 1;
+u8 drive_activity = 0;     // Frames left of recent drive access (auto-warp and run-ahead)
 u8 last_drive_access_write = 0;
 
 void floppy_soundfx(u8 is_write)
 {
+    drive_activity = 40;
+
     if (myConfig.diskFlash & 1)
     {
         if (floppy_sound_counter == 0) floppy_sound_counter = 250;
@@ -301,6 +305,7 @@ s16 temp_offset_x   __attribute__((section(".dtcm"))) = 0;
 u8  slide_dampen_y  __attribute__((section(".dtcm"))) = 0;
 u8  slide_dampen_x  __attribute__((section(".dtcm"))) = 0;
 u16 DSIvBlanks      __attribute__((section(".dtcm"))) = 0;
+u32 vblank_count    __attribute__((section(".dtcm"))) = 0;    // Never reset - for timing longer runs
 
 int8 currentBrightness = 0;
 const int8 brightness[] = {0, -6, -12, -15};
@@ -320,6 +325,7 @@ __attribute__ ((noinline)) void HandleBrightness(void)
 ITCM_CODE void vblankDS(void)
 {
     DSIvBlanks++;
+    vblank_count++;
     int cxBG = ((s16)myConfig.offsetX+temp_offset_x) << 8;
     int cyBG = ((s16)myConfig.offsetY+temp_offset_y) << 8;
     int xdxBG = ((320 / myConfig.scaleX) << 8) | (320 % myConfig.scaleX) ;
@@ -375,6 +381,8 @@ ITCM_CODE void vblankDS(void)
         HandleBrightness();
     }
 
+    if (drive_activity) drive_activity--;
+
     // We allow the drive icon to stay on for 1-2 seconds for better visibility
     if (dampen_drive_led)
     {
@@ -482,6 +490,46 @@ int init_graphics(void)
     return TRUE;
 }
 
+/*
+ *  Snapshot thumbnails: every 4th pixel of the 320x200 display window as it is
+ *  on the LCD. ShowThumbnail() puts one over the top right of the (paused)
+ *  screen - and NULL puts back what was under it.
+ */
+#define THUMB_LCD_LINE(y)   ((u8*)0x06000000 + 512*(ROW25_YSTART-FIRST_DISP_LINE+(y)) + COL40_XSTART)
+
+void C64Display::GrabThumbnail(uint8 *thumb)
+{
+    for (int y=0; y<SNAPSHOT_THUMB_H; y++)
+    {
+        u8 *lcd = THUMB_LCD_LINE(y*4);
+        for (int x=0; x<SNAPSHOT_THUMB_W; x++) *thumb++ = lcd[x*4];
+    }
+}
+
+void C64Display::ShowThumbnail(uint8 *thumb)
+{
+    static u16 under[SNAPSHOT_THUMB_SIZE/2];
+    static u8 shown = false;
+
+    for (int y=0; y<SNAPSHOT_THUMB_H; y++)
+    {
+        // VRAM takes 16-bit writes only
+        u16 *lcd = (u16*)(THUMB_LCD_LINE(y+4) + 320 - SNAPSHOT_THUMB_W - 4);
+        u16 *save = under + y*(SNAPSHOT_THUMB_W/2);
+        for (int x=0; x<SNAPSHOT_THUMB_W/2; x++)
+        {
+            if (thumb)
+            {
+                if (!shown) save[x] = lcd[x];
+                lcd[x] = thumb[y*SNAPSHOT_THUMB_W + x*2] | (thumb[y*SNAPSHOT_THUMB_W + x*2 + 1] << 8);
+            }
+            else if (shown) lcd[x] = save[x];
+        }
+    }
+    shown = (thumb != NULL);
+}
+
+
 /*
  *  Redraw one raster line of the bitmap to the LCD
  */
@@ -628,6 +676,13 @@ void C64Display::DisplayStatusLine(int speed)
 
         sprintf(tmp, "FPS %3d", speed);
         DSPrint(25, 0, 0, tmp);
+
+        sprintf(tmp, "SND UND %-5d OVR %-5d DST %-4d", (int)(sid_underruns % 100000), (int)(sid_overruns % 100000), (int)sid_distance);
+        DSPrint(0, 17, 0, tmp);
+
+        // Timer ticks at 33.5MHz/64 - about 10470 to a 50Hz frame
+        sprintf(tmp, "RUNAHEAD %5d TK %3d%%", (int)run_ahead_ticks, (int)(run_ahead_ticks * 100 / 10470));
+        DSPrint(0, 19, 0, tmp);
     }
 }
 
@@ -896,6 +951,7 @@ void C64Display::PollKeyboard(uint8 *key_matrix, uint8 *rev_matrix, uint8 *joyst
                     TheC64->NewPrefs(prefs);
                     TheDrivePrefs = *prefs;
                     delete prefs;
+                    TheC64->MovieDiskSwap(reload == 2);
 
                     // See if we should issue a system-wide RESET
                     if (reload == 2)
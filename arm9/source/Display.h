@@ -60,6 +60,8 @@ public:
     void InitColors(uint8 *colors);
     void NewPrefs(DrivePrefs *prefs);
     void IssueKeypress(uint8 row, uint8 col, uint8 *key_matrix, uint8 *rev_matrix);
+    void GrabThumbnail(uint8 *thumb);
+    void ShowThumbnail(uint8 *thumb);
     C64 *TheC64;
 
 public:
@@ -71,6 +73,7 @@ public:
 extern long ShowRequester(const char *str, const char *button1, const char *button2 = NULL);
 extern u8 issue_commodore_key;
 extern u8 dampen_drive_led;
+extern u8 drive_activity;
 extern int8 currentBrightness;
 extern uint16 dimDampen;
 extern void toggle_zoom(void);
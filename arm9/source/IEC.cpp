@@ -61,6 +61,7 @@
 #include "sysdeps.h"
 #include "IEC.h"
 #include "1541d64.h"
+#include "1541gcr.h"
 #include "Display.h"
 #include "main.h"
 #include "printf.h"
@@ -149,6 +150,40 @@ void IEC::Reset(void)
 }
 
 
+/*
+ *  Write back sectors the drives hold in RAM
+ */
+
+void IEC::Flush(void)
+{
+    for (int i=0; i<2; i++)
+        if (drive[i] != NULL)
+            drive[i]->Flush();
+}
+
+
+/*
+ *  Load a file in one go for the kernal LOAD trap. Returns false if the
+ *  load has to go through the regular byte-by-byte IEC transfer instead.
+ */
+
+bool IEC::Load(uint8 *ram, int device, uint16 name_adr, int name_len, bool file_adr, uint16 &start, uint16 &end)
+{
+    if ((device < 8) || (device > 9) || (name_len == 0) || (name_len >= NAMEBUF_LENGTH))
+        return false;
+
+    Drive *d = drive[device-8];
+    if (d == NULL || !d->Ready)
+        return false;
+
+    for (int i=0; i<name_len; i++)
+        name_buf[i] = ram[(name_adr + i) & 0xffff];
+    name_buf[name_len] = 0;
+
+    return d->Load(name_buf, name_len, ram, file_adr, start, end);
+}
+
+
 /*
  *  Preferences have changed, prefs points to new preferences,
  *  TheDrivePrefs still holds the previous ones. Check if drive settings
@@ -972,5 +1007,9 @@ bool IsMountableFile(const char *path, int &type)
         type = FILE_IMAGE;
         return true;
     }
+    else if (IsGCRImageFile(path, header, size)) {
+        type = FILE_GCR_IMAGE;
+        return true;
+    }
     else return false;
 }
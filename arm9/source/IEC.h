@@ -92,6 +92,7 @@ enum {
 // Mountable file types
 enum {
     FILE_IMAGE,         // Disk image, handled by ImageDrive
+    FILE_GCR_IMAGE,     // GCR disk image (.g64), needs processor-level 1541 emulation
     FILE_ARCH           // Archive file, handled by ArchDrive
 };
 
@@ -156,6 +157,8 @@ public:
     void Reset(void);
     void NewPrefs(DrivePrefs *prefs);
     void UpdateLEDs(void);
+    void Flush(void);
+    bool Load(uint8 *ram, int device, uint16 name_adr, int name_len, bool file_adr, uint16 &start, uint16 &end);
 
     uint8 Out(uint8 byte, bool eoi);
     uint8 OutATN(uint8 byte);
@@ -209,6 +212,8 @@ public:
     virtual uint8 Read(int channel, uint8 &byte)=0;
     virtual uint8 Write(int channel, uint8 byte, bool eoi)=0;
     virtual void Reset(void)=0;
+    virtual void Flush(void) {}     // Write back anything held in RAM
+    virtual bool Load(const uint8 *name, int name_len, uint8 *ram, bool file_adr, uint16 &start, uint16 &end) { return false; }
 
     int LED;            // Drive LED state
     bool Ready;         // Drive is ready for operation
@@ -54,6 +54,8 @@
 
 #include "SID.h"
 #include "1541d64.h"
+#include "mainmenu.h"
+#include "SIDFifo.h"
 
 #define FIXPOINT_PREC           16    // number of fractional bits used in fixpoint representation
 #define PRECOMPUTE_RESONANCE    1     // For a bit of added speed
@@ -62,6 +64,7 @@
 #include "FixPoint.h"
 
 uint8 regs[32]                __attribute__((section(".dtcm")));  // Copies of the 32 write-only SID registers
+uint8 regs2[32];                                                  // Same for the optional second SID
 uint8 last_sid_byte           __attribute__((section(".dtcm")));  // Last value written to SID
 uint32_t sid_random_seed      __attribute__((section(".dtcm")));  // Random seed - global so it's deterministic
 
@@ -87,14 +90,17 @@ static uint8 sid_random(void)
  *  Constructor
  */
 
-MOS6581::MOS6581(C64 *c64) : the_c64(c64)
+MOS6581::MOS6581(C64 *c64, MOS6581 *first) : the_c64(c64)
 {
     the_renderer = NULL;
+    sid_regs = (first ? regs2 : regs);
+    reg_base = (first ? 32 : 0);
     for (int i=0; i<32; i++)
-        regs[i] = 0;
+        sid_regs[i] = 0;
 
-    // Open the renderer
-    open_close_renderer(SIDTYPE_NONE, SIDTYPE_DIGITAL);
+    // Open the renderer - a second SID plays through the first one's
+    if (first) the_renderer = first->the_renderer;
+    else open_close_renderer(SIDTYPE_NONE, SIDTYPE_DIGITAL);
 }
 
 
@@ -105,7 +111,7 @@ MOS6581::MOS6581(C64 *c64) : the_c64(c64)
 MOS6581::~MOS6581()
 {
     // Close the renderer
-    open_close_renderer(SIDTYPE_DIGITAL, SIDTYPE_NONE);
+    if (!reg_base) open_close_renderer(SIDTYPE_DIGITAL, SIDTYPE_NONE);
 }
 
 
@@ -117,10 +123,12 @@ void MOS6581::Reset(void)
 {
     for (int i=0; i<32; i++)
     {
-        regs[i] = 0;
+        sid_regs[i] = 0;
     }
-    last_sid_byte = 0;
     fake_v3_count = 0x555555;
+    if (reg_base) return;   // The renderer and the shared bits belong to the first SID
+
+    last_sid_byte = 0;
     sid_random_seed = 1;
 
     // Reset the renderer
@@ -137,6 +145,8 @@ void MOS6581::Reset(void)
 
 void MOS6581::NewPrefs(DrivePrefs *prefs)
 {
+    if (reg_base) return;
+
     open_close_renderer(SIDTYPE_DIGITAL, SIDTYPE_DIGITAL);
     if (the_renderer != NULL)
     {
@@ -177,34 +187,34 @@ void MOS6581::ResumeSound(void)
 
 void MOS6581::GetState(MOS6581State *ss)
 {
-    ss->freq_lo_1 = regs[0];
-    ss->freq_hi_1 = regs[1];
-    ss->pw_lo_1 = regs[2];
-    ss->pw_hi_1 = regs[3];
-    ss->ctrl_1 = regs[4];
-    ss->AD_1 = regs[5];
-    ss->SR_1 = regs[6];
-
-    ss->freq_lo_2 = regs[7];
-    ss->freq_hi_2 = regs[8];
-    ss->pw_lo_2 = regs[9];
-    ss->pw_hi_2 = regs[10];
-    ss->ctrl_2 = regs[11];
-    ss->AD_2 = regs[12];
-    ss->SR_2 = regs[13];
-
-    ss->freq_lo_3 = regs[14];
-    ss->freq_hi_3 = regs[15];
-    ss->pw_lo_3 = regs[16];
-    ss->pw_hi_3 = regs[17];
-    ss->ctrl_3 = regs[18];
-    ss->AD_3 = regs[19];
-    ss->SR_3 = regs[20];
-
-    ss->fc_lo = regs[21];
-    ss->fc_hi = regs[22];
-    ss->res_filt = regs[23];
-    ss->mode_vol = regs[24];
+    ss->freq_lo_1 = sid_regs[0];
+    ss->freq_hi_1 = sid_regs[1];
+    ss->pw_lo_1 = sid_regs[2];
+    ss->pw_hi_1 = sid_regs[3];
+    ss->ctrl_1 = sid_regs[4];
+    ss->AD_1 = sid_regs[5];
+    ss->SR_1 = sid_regs[6];
+
+    ss->freq_lo_2 = sid_regs[7];
+    ss->freq_hi_2 = sid_regs[8];
+    ss->pw_lo_2 = sid_regs[9];
+    ss->pw_hi_2 = sid_regs[10];
+    ss->ctrl_2 = sid_regs[11];
+    ss->AD_2 = sid_regs[12];
+    ss->SR_2 = sid_regs[13];
+
+    ss->freq_lo_3 = sid_regs[14];
+    ss->freq_hi_3 = sid_regs[15];
+    ss->pw_lo_3 = sid_regs[16];
+    ss->pw_hi_3 = sid_regs[17];
+    ss->ctrl_3 = sid_regs[18];
+    ss->AD_3 = sid_regs[19];
+    ss->SR_3 = sid_regs[20];
+
+    ss->fc_lo = sid_regs[21];
+    ss->fc_hi = sid_regs[22];
+    ss->res_filt = sid_regs[23];
+    ss->mode_vol = sid_regs[24];
 
     ss->pot_x = 0xff;
     ss->pot_y = 0xff;
@@ -229,44 +239,45 @@ void MOS6581::GetState(MOS6581State *ss)
 
 void MOS6581::SetState(MOS6581State *ss)
 {
-    regs[0] = ss->freq_lo_1;
-    regs[1] = ss->freq_hi_1;
-    regs[2] = ss->pw_lo_1;
-    regs[3] = ss->pw_hi_1;
-    regs[4] = ss->ctrl_1;
-    regs[5] = ss->AD_1;
-    regs[6] = ss->SR_1;
-
-    regs[7] = ss->freq_lo_2;
-    regs[8] = ss->freq_hi_2;
-    regs[9] = ss->pw_lo_2;
-    regs[10] = ss->pw_hi_2;
-    regs[11] = ss->ctrl_2;
-    regs[12] = ss->AD_2;
-    regs[13] = ss->SR_2;
-
-    regs[14] = ss->freq_lo_3;
-    regs[15] = ss->freq_hi_3;
-    regs[16] = ss->pw_lo_3;
-    regs[17] = ss->pw_hi_3;
-    regs[18] = ss->ctrl_3;
-    regs[19] = ss->AD_3;
-    regs[20] = ss->SR_3;
-
-    regs[21] = ss->fc_lo;
-    regs[22] = ss->fc_hi;
-    regs[23] = ss->res_filt;
-    regs[24] = ss->mode_vol;
+    sid_regs[0] = ss->freq_lo_1;
+    sid_regs[1] = ss->freq_hi_1;
+    sid_regs[2] = ss->pw_lo_1;
+    sid_regs[3] = ss->pw_hi_1;
+    sid_regs[4] = ss->ctrl_1;
+    sid_regs[5] = ss->AD_1;
+    sid_regs[6] = ss->SR_1;
+
+    sid_regs[7] = ss->freq_lo_2;
+    sid_regs[8] = ss->freq_hi_2;
+    sid_regs[9] = ss->pw_lo_2;
+    sid_regs[10] = ss->pw_hi_2;
+    sid_regs[11] = ss->ctrl_2;
+    sid_regs[12] = ss->AD_2;
+    sid_regs[13] = ss->SR_2;
+
+    sid_regs[14] = ss->freq_lo_3;
+    sid_regs[15] = ss->freq_hi_3;
+    sid_regs[16] = ss->pw_lo_3;
+    sid_regs[17] = ss->pw_hi_3;
+    sid_regs[18] = ss->ctrl_3;
+    sid_regs[19] = ss->AD_3;
+    sid_regs[20] = ss->SR_3;
+
+    sid_regs[21] = ss->fc_lo;
+    sid_regs[22] = ss->fc_hi;
+    sid_regs[23] = ss->res_filt;
+    sid_regs[24] = ss->mode_vol;
 
     fake_v3_count = ss->v3_count;
     fake_v3_eg_level = ss->v3_eg_level;
     fake_v3_eg_state = ss->v3_eg_state;
     sid_random_seed = ss->sid_seed;
 
-    // Stuff the new register values into the renderer
-    if (the_renderer != NULL)
+    // Stuff the new register values into the renderer - unless we are only
+    // coming back from a run-ahead, which the renderer never heard about
+    if (the_renderer != NULL && !bRunAhead)
         for (int i=0; i<25; i++)
-            the_renderer->WriteRegister(i, regs[i]);
+            the_renderer->WriteRegister(i + reg_base, sid_regs[i]);
 }
 
 
@@ -287,6 +298,66 @@ const int SAMPLE_BUF_SIZE       = (0x138*4);                              // Siz
 uint8 sample_vol_filt[SAMPLE_BUF_SIZE] __attribute__((section(".dtcm"))); // Buffer for sampled volumes and filter bits shifted up
 int sample_in_ptr                      __attribute__((section(".dtcm"))); // Index in sample_vol_filt[] for writing
 
+// -----------------------------------------------------------------------------------------
+// The sound callback reads sample_vol_filt[] from its own position which should trail the
+// per-line writer by half the buffer. If the emulation runs slow the reader catches up with
+// the writer (underrun) and if it runs fast the writer laps the reader (overrun) - either
+// way the digis crackle. The step through the buffer is nudged by how far the distance is
+// off centre so small speed differences never get that far. Counters are for the status line.
+// -----------------------------------------------------------------------------------------
+#define SAMPLE_STEP_NUDGE_SHIFT 4     // The nudge can move the step by up to 1/16th
+
+uint32 sample_out_ptr                  __attribute__((section(".dtcm"))); // Index in sample_vol_filt[] for reading, 16.16 fixed
+uint32 sid_underruns                   __attribute__((section(".dtcm"))); // Reader caught up with the writer
+uint32 sid_overruns                    __attribute__((section(".dtcm"))); // Writer about to lap the reader
+int32  sid_distance                    __attribute__((section(".dtcm"))); // Lines between reader and writer at the last callback
+
+// -----------------------------------------------------------------------------------------
+// Filter coefficient tables - one entry for every 11-bit cutoff value (FC_HI:FC_LO) and
+// every one of the 16 resonance settings. The per-cutoff tables are rebuilt only when the
+// filter mode switches to a different resonance curve. The g1 table (2.14 fixed point to
+// keep it at 64K) is filled in on first use so a filter sweep only pays for the square root
+// once per cutoff step instead of on every register write.
+// -----------------------------------------------------------------------------------------
+#define FILT_TABLE_FC           2048
+#define FILT_TABLE_RES          16
+#define FILT_G1_EMPTY           0x7F7F  // Marks an entry not yet computed - |g1| never gets near 2.0
+
+#define FILT_MODE_HP            0x01    // Uses the highpass resonance curve (HP, BP and Notch)
+#define FILT_MODE_BP            0x02    // Bandpass mixed in (LP+BP, HP+BP)
+#define FILT_MODE_INVALID       0xFF
+
+// -----------------------------------------------------------------------------------------
+// Optional oversampled output - the voices and filter are run at twice the output rate and
+// the result is decimated back down through a 16-tap lowpass FIR. Only the phase of the FIR
+// we keep is ever computed and the taps are symmetric so each output costs 8 multiplies.
+// This cuts the aliasing of the raw waveforms at the cost of running the voice loop twice.
+// -----------------------------------------------------------------------------------------
+#define OVERSAMPLE_SHIFT        1       // log2 of the oversampling factor when enabled
+#define FIR_TAPS                16
+
+const int16 FIRTable[FIR_TAPS/2] = {-7, 20, 137, -21, -722, -451, 2683, 6553};    // 2.14 fixed, outer taps first
+
+int32 fir_hist[FIR_TAPS*2]  __attribute__((section(".dtcm")));    // Decimation history - doubled so the taps never wrap
+int fir_pos                 __attribute__((section(".dtcm")));    // Index in fir_hist[] for writing
+
+int16    filt_g1_table[FILT_TABLE_RES][FILT_TABLE_FC];  // g1 for each resonance and cutoff
+FixPoint filt_g2_table[FILT_TABLE_FC];                  // g2 without the resonance term
+FixPoint filt_cos_table[FILT_TABLE_FC];                 // cos(arg) for the Notch filter
+FixPoint filt_notch_table[FILT_TABLE_FC];               // (1 + cos(arg)) / sin(arg) for the Notch filter
+
+// -----------------------------------------------------------------------------------------
+// Optional SID engine on the ARM7 - the voices are rendered on the other core and we only
+// forward the register writes, stamped with the raster line they happened on, plus a frame
+// marker at the top of each frame. See SIDFifo.h for the message format.
+// -----------------------------------------------------------------------------------------
+bool   sid_on_arm7          __attribute__((section(".dtcm"))) = false;
+uint16 sid_line             __attribute__((section(".dtcm"))) = 0;    // Raster line within the frame
+uint16 sid_frame            __attribute__((section(".dtcm"))) = 0;    // Frame counter sent with each marker
+
+u16 sid7_waves[SID7_WAVE_TABLE_SIZE] __attribute__((aligned(32)));   // Main RAM copy of the combined waveforms for the ARM7
+extern bool paused;
+
 // SID waveforms (some of them :-)
 enum {
     WAVE_NONE,
@@ -344,7 +415,25 @@ struct DRVoice {
     bool mute;      // Voice muted (voice 3 only)
 };
 
-DRVoice voice[3] __attribute__((section(".dtcm"))); // Data for 3 voices
+DRVoice voice[6] __attribute__((section(".dtcm"))); // Data for 3 voices - and 3 more for the optional second SID
+
+// Structure for the rest of one chip - master volume, filter routing and the filter
+struct DRChip {
+    uint8 volume;                   // Master volume
+    uint8 res_filt;                 // RES/FILT register
+    uint8 f_type;                   // Filter type
+    uint8 f_freq;                   // SID filter frequency (upper 8 bits)
+    uint8 f_freq_low;               // SID filter frequency (lower 3 bits)
+    uint8 f_res;                    // Filter resonance (0..15)
+    bool f_snap;                    // Filter type changed - jump straight to the new coefficients
+    FixPoint f_ampl;
+    FixPoint d1, d2, g1, g2;
+    FixPoint r_ampl;                // Coefficients used at the end of the last buffer - calc_buffer()
+    FixPoint r_d1, r_d2, r_g1, r_g2;// ramps from these to the ones above across the next buffer
+    FixPoint s_ampl;                // Per-sample ramp steps - only valid inside calc_buffer()
+    FixPoint s_d1, s_d2, s_g1, s_g2;
+    int32 xn1, xn2, yn1, yn2;       // can become very large
+};
 
 // Renderer class
 class DigitalRenderer : public SIDRenderer {
@@ -363,9 +452,14 @@ public:
     //bool ready;                     // Flag: Renderer has initialized and is ready
 private:
     void init_sound(void);
-    void calc_filter(void);
-    uint8 volume;                   // Master volume
-    uint8_t res_filt;				// RES/FILT register
+    void calc_filter(DRChip *ch);
+    void calc_filter_point(uint8 mode, int fc, FixPoint &g2, FixPoint &f_cos, FixPoint &f_notch);
+    void build_filter_table(uint8 mode);
+    void set_quality(void);
+    void set_engine(void);
+    void send_filter(void);
+    int32 eg_rate(int idx) {return (isDSiMode() ? EGTableDSi[idx] : EGTable[idx]) >> os_shift;}
+    int filter_rate(void) {return sid_on_arm7 ? SID7_SAMPLE_FREQ : ((isDSiMode() ? SAMPLE_FREQ_DSI : SAMPLE_FREQ) << os_shift);}
 
     static const uint16 TriSawTable[0x100];
     static const uint16 TriRectTable[0x100];
@@ -374,13 +468,11 @@ private:
     static const int32_t EGTable[16];      // Increment/decrement values for all A/D/R settings
     static const int32_t EGTableDSi[16];   // Increment/decrement values for all A/D/R settings
 
-    uint8 f_type;                   // Filter type
-    uint8 f_freq;                   // SID filter frequency (upper 8 bits)
-    uint8 f_freq_low;               // SID filter frequency (lower 4 bits)
-    uint8 f_res;                    // Filter resonance (0..15)
-    FixPoint f_ampl;
-    FixPoint d1, d2, g1, g2;
-    int32 xn1, xn2, yn1, yn2;       // can become very large
+    DRChip chip[2];                 // The first SID and the optional second one (registers 32 and up)
+    int n_chips;                    // Number of chips rendered - 2 when a second SID is mapped
+    uint8 f_table_mode;             // FILT_MODE_xxx the cutoff tables were last built for
+    uint8 os_shift;                 // Oversampling - 0 for synthesis at the output rate, else OVERSAMPLE_SHIFT
+    int32 f_sent[6];                // SID7_COEF_xxx values last sent to the ARM7 (-1 = send again)
     FixPoint sidquot;
 #ifdef PRECOMPUTE_RESONANCE
     FixPoint resonanceLP[257];
@@ -589,13 +681,15 @@ uint8_t EGDRShift[256] __attribute__((section(".dtcm"))) = {
 
 DigitalRenderer::DigitalRenderer()
 {
-    // Link voices together
-    voice[0].mod_by = &voice[2];
-    voice[1].mod_by = &voice[0];
-    voice[2].mod_by = &voice[1];
-    voice[0].mod_to = &voice[1];
-    voice[1].mod_to = &voice[2];
-    voice[2].mod_to = &voice[0];
+    // Link voices together - each chip's three voices form their own ring
+    for (int c=0; c<6; c+=3) {
+        voice[c+0].mod_by = &voice[c+2];
+        voice[c+1].mod_by = &voice[c+0];
+        voice[c+2].mod_by = &voice[c+1];
+        voice[c+0].mod_to = &voice[c+1];
+        voice[c+1].mod_to = &voice[c+2];
+        voice[c+2].mod_to = &voice[c+0];
+    }
 
 #ifdef PRECOMPUTE_RESONANCE
     // slow floating point doesn't matter much on startup!
@@ -603,16 +697,16 @@ DigitalRenderer::DigitalRenderer()
       resonanceLP[i] = FixNo(CALC_RESONANCE_LP(i));
       resonanceHP[i] = FixNo(CALC_RESONANCE_HP(i));
     }
-    // Pre-compute the quotient. No problem since int-part is small enough
-    sidquot = (isDSiMode() ? SID_CYCLES_FIX_DSI : SID_CYCLES_FIX);
     // compute lookup table for sin and cos
     InitFixSinTab();
 #endif
+    set_quality();
 
     Reset();
 
     // System specific initialization
     init_sound();
+    set_engine();
 }
 
 
@@ -622,29 +716,39 @@ DigitalRenderer::DigitalRenderer()
 
 void DigitalRenderer::Reset(void)
 {
-    volume = 0;
-    res_filt = 0;
+    n_chips = (myConfig.sid2Addr ? 2 : 1);
 
-    for (int v=0; v<3; v++) {
+    for (int v=0; v<6; v++) {
         voice[v].wave = WAVE_NONE;
         voice[v].eg_state = EG_RELEASE;
         voice[v].count = 0x555555;
         voice[v].add = 0;
         voice[v].freq = voice[v].pw = 0;
         voice[v].eg_level = voice[v].s_level = 0;
-        voice[v].a_add = voice[v].d_sub = voice[v].r_sub = (isDSiMode() ? EGTableDSi[0] : EGTable[0]);
+        voice[v].a_add = voice[v].d_sub = voice[v].r_sub = eg_rate(0);
         voice[v].gate = voice[v].ring = voice[v].test = false;
         voice[v].sync = voice[v].mute = false;
     }
 
-    f_type = FILT_NONE;
-    f_freq = f_res = 0;
-    f_freq_low = 0;
-    f_ampl = FixNo(1);
-    d1 = d2 = g1 = g2 = 0;
-    xn1 = xn2 = yn1 = yn2 = 0;
+    for (int c=0; c<2; c++) {
+        chip[c].volume = 0;
+        chip[c].res_filt = 0;
+        chip[c].f_type = FILT_NONE;
+        chip[c].f_freq = chip[c].f_res = 0;
+        chip[c].f_freq_low = 0;
+        chip[c].f_ampl = FixNo(1);
+        chip[c].d1 = chip[c].d2 = chip[c].g1 = chip[c].g2 = 0;
+        chip[c].xn1 = chip[c].xn2 = chip[c].yn1 = chip[c].yn2 = 0;
+        chip[c].f_snap = true;
+    }
+
+    memset(fir_hist, 0, sizeof(fir_hist));
+    fir_pos = 0;
 
     sample_in_ptr = 0;
+    sample_out_ptr = (SAMPLE_BUF_SIZE/2) << 16;
+    sid_underruns = sid_overruns = 0;
+    sid_distance = SAMPLE_BUF_SIZE/2;
     memset(sample_vol_filt, 0, SAMPLE_BUF_SIZE);
 
     // -------------------------------------------------------------------
@@ -662,6 +766,13 @@ void DigitalRenderer::Reset(void)
         ptr3[i] = SawRectTable[i];
         ptr4[i] = TriSawRectTable[i];
     }
+
+    if (sid_on_arm7)
+    {
+        fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_RESET, 0));
+        memset(f_sent, 0xFF, sizeof(f_sent));
+        send_filter();
+    }
 }
 
 
@@ -671,9 +782,11 @@ void DigitalRenderer::Reset(void)
 
 void DigitalRenderer::WriteRegister(uint16 adr, uint8 byte)
 {
-    int v = adr/7;  // Voice number
+    DRChip *ch = &chip[adr >> 5];           // Registers 32 and up are the second SID
+    int v = (adr & 0x1f)/7 + (adr >> 5)*3;  // Voice number
+    bool new_filter = false;                // Filter coefficients recalculated
 
-    switch (adr) {
+    switch (adr & 0x1f) {
         case 0:
         case 7:
         case 14:
@@ -723,45 +836,56 @@ void DigitalRenderer::WriteRegister(uint16 adr, uint8 byte)
         case 5:
         case 12:
         case 19:
-            voice[v].a_add = (isDSiMode() ? EGTableDSi[byte >> 4] : EGTable[byte >> 4]);
-            voice[v].d_sub = (isDSiMode() ? EGTableDSi[byte & 0xf] : EGTable[byte & 0xf]);
+            voice[v].a_add = eg_rate(byte >> 4);
+            voice[v].d_sub = eg_rate(byte & 0xf);
             break;
 
         case 6:
         case 13:
         case 20:
             voice[v].s_level = (byte >> 4) * 0x111111;
-            voice[v].r_sub = (isDSiMode() ? EGTableDSi[byte & 0xf] : EGTable[byte & 0xf]);
+            voice[v].r_sub = eg_rate(byte & 0xf);
             break;
 
         case 21: // Filter Frequency - lower 3 bits
-            f_freq_low = ((byte & 0x7) > 3) ? 1:0;
-            calc_filter();
+            ch->f_freq_low = byte & 0x7;
+            calc_filter(ch);
+            new_filter = true;
             break;
 
         case 22: // Filter Frequency - upper 8 bits
-            f_freq = byte;
-            calc_filter();
+            ch->f_freq = byte;
+            calc_filter(ch);
+            new_filter = true;
             break;
 
         case 23:
-            res_filt = byte;
-            if ((byte >> 4) != f_res) {
-                f_res = byte >> 4;
-                calc_filter();
+            ch->res_filt = byte;
+            if ((byte >> 4) != ch->f_res) {
+                ch->f_res = byte >> 4;
+                calc_filter(ch);
+                new_filter = true;
             }
             break;
 
         case 24:
-            volume = byte & 0xf;
-            voice[2].mute = byte & 0x80;
-            if (((byte >> 4) & 7) != f_type) {
-                f_type = (byte >> 4) & 7;
-                xn1 = xn2 = yn1 = yn2 = 0;
-                calc_filter();
+            ch->volume = byte & 0xf;
+            voice[v-1].mute = byte & 0x80;  // Voice 3 of this chip - 24/7 lands one past it
+            if (((byte >> 4) & 7) != ch->f_type) {
+                ch->f_type = (byte >> 4) & 7;
+                ch->xn1 = ch->xn2 = ch->yn1 = ch->yn2 = 0;
+                ch->f_snap = true;
+                calc_filter(ch);
+                new_filter = true;
             }
             break;
     }
+
+    if (sid_on_arm7 && adr < 32)
+    {
+        fifoSendValue32(FIFO_SID7, SID7_MSG_REG(sid_line, adr, byte));
+        if (new_filter) send_filter();  // Never for plain volume writes - digis hammer $D418
+    }
 }
 
 
@@ -771,77 +895,259 @@ void DigitalRenderer::WriteRegister(uint16 adr, uint8 byte)
 
 void DigitalRenderer::NewPrefs(DrivePrefs *prefs)
 {
-    calc_filter();
+    if ((myGlobalConfig.sidQuality ? OVERSAMPLE_SHIFT : 0) != os_shift)
+    {
+        set_quality();
+
+        // Oscillator and envelope rates depend on the synthesis rate
+        for (int i=0; i<25; i++)
+        {
+            WriteRegister(i, regs[i]);
+            WriteRegister(i + 32, regs2[i]);
+        }
+    }
+    n_chips = (myConfig.sid2Addr ? 2 : 1);
+    calc_filter(&chip[0]);
+    calc_filter(&chip[1]);
+    set_engine();
 }
 
 
 /*
- *  Calculate IIR filter coefficients
+ *  Pick up the SID engine setting - either we render the voices here
+ *  through the maxmod stream or hand the register writes to the ARM7
  */
 
-void DigitalRenderer::calc_filter(void)
+void DigitalRenderer::set_engine(void)
 {
-    FixPoint fr, arg;
+    bool arm7 = myGlobalConfig.sidEngine && (n_chips == 1);    // The ARM7 engine only has the three voices
+    if (arm7 == sid_on_arm7) return;
 
-    if (f_type == FILT_ALL)
+    if (arm7)
     {
-        d1 = 0; d2 = 0; g1 = 0; g2 = 0; f_ampl = FixNo(1); return;
+        mmStreamClose();
+        mmLockChannels(BIT(SID7_CHANNEL));
+
+        // The ARM7 can't see our VRAM copies of the combined waveforms
+        memcpy(&sid7_waves[0x000], TriSawTable,     sizeof(TriSawTable));
+        memcpy(&sid7_waves[0x100], TriRectTable,    sizeof(TriRectTable));
+        memcpy(&sid7_waves[0x200], SawRectTable,    sizeof(SawRectTable));
+        memcpy(&sid7_waves[0x300], TriSawRectTable, sizeof(TriSawRectTable));
+        DC_FlushRange(sid7_waves, sizeof(sid7_waves));
+
+        fifoSendAddress(FIFO_SID7, sid7_waves);
+        fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_START, 0));
+        if (paused) fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_PAUSE, 0));
+
+        sid_on_arm7 = true;
+        sid_line = 0;
+
+        // Bring the ARM7 voices up to date - with the filter worked out for its rate
+        f_table_mode = FILT_MODE_INVALID;
+        calc_filter(&chip[0]);
+        memset(f_sent, 0xFF, sizeof(f_sent));
+        for (int i=0; i<25; i++)
+            WriteRegister(i, regs[i]);
+        send_filter();
     }
-    else if (f_type == FILT_NONE)
+    else
     {
-        d1 = 0; d2 = 0; g1 = 0; g2 = 0; f_ampl = 0; return;
+        fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_STOP, 0));
+        mmUnlockChannels(BIT(SID7_CHANNEL));
+        sid_on_arm7 = false;
+        f_table_mode = FILT_MODE_INVALID;   // Back to the tables for our own synthesis rate
+        calc_filter(&chip[0]);
+        calc_filter(&chip[1]);
+        chip[0].f_snap = chip[1].f_snap = true;
+        init_sound();
     }
+}
 
-    // Calculate resonance frequency
-    if (f_type == FILT_LP || f_type == FILT_LPBP)
-#ifdef PRECOMPUTE_RESONANCE
-        fr = resonanceLP[f_freq + f_freq_low];
-#else
-        fr = CALC_RESONANCE_LP(f_freq);
-#endif
-    else
+
+/*
+ *  Send the filter coefficients that changed to the ARM7 - they come out of
+ *  our tables (built for SID7_SAMPLE_FREQ while the ARM7 renders) so it's far
+ *  cheaper to ship them than to compute them over there
+ */
+
+void DigitalRenderer::send_filter(void)
+{
+    DRChip *ch = &chip[0];
+    int32 ampl = ch->f_ampl.Value();
+    int32 coef[6];
+
+    coef[SID7_COEF_AMPL_LO] = ampl & 0xffff;
+    coef[SID7_COEF_AMPL_HI] = (ampl >> 16) & 0xffff;
+    coef[SID7_COEF_D1] = (ch->d1.Value() >> 3) & 0xffff;
+    coef[SID7_COEF_D2] = (ch->d2.Value() >> 3) & 0xffff;
+    coef[SID7_COEF_G1] = (ch->g1.Value() >> 2) & 0xffff;
+    coef[SID7_COEF_G2] = (ch->g2.Value() >> 2) & 0xffff;
+
+    // The low half of the amplification is only latched - the high half applies both
+    if (coef[SID7_COEF_AMPL_LO] != f_sent[SID7_COEF_AMPL_LO]) f_sent[SID7_COEF_AMPL_HI] = -1;
+
+    for (int i=0; i<6; i++)
+    {
+        if (coef[i] == f_sent[i]) continue;
+        fifoSendValue32(FIFO_SID7, SID7_MSG_COEFF(sid_line, i, coef[i]));
+        f_sent[i] = coef[i];
+    }
+}
+
+
+/*
+ *  Pick up the SID quality setting - everything that depends on the
+ *  rate the voices are synthesized at is set up from here
+ */
+
+void DigitalRenderer::set_quality(void)
+{
+    os_shift = (myGlobalConfig.sidQuality ? OVERSAMPLE_SHIFT : 0);
+
+    // Pre-compute the quotient. No problem since int-part is small enough
+    sidquot = (isDSiMode() ? SID_CYCLES_FIX_DSI : SID_CYCLES_FIX) >> os_shift;
+
+    f_table_mode = FILT_MODE_INVALID;   // Filter tables are built for the synthesis rate
+    chip[0].f_snap = chip[1].f_snap = true;
+}
+
+
+/*
+ *  Resonance curve values for one 11-bit cutoff on the given FILT_MODE_xxx
+ */
+
+void DigitalRenderer::calc_filter_point(uint8 mode, int fc, FixPoint &g2, FixPoint &f_cos, FixPoint &f_notch)
+{
+    FixPoint fr, arg;
+
+    // Calculate resonance frequency - interpolated between the steps of the upper 8 cutoff bits
 #ifdef PRECOMPUTE_RESONANCE
-        fr = resonanceHP[f_freq+f_freq_low];
+    FixPoint *resonance = (mode & FILT_MODE_HP) ? resonanceHP : resonanceLP;
+    int32 fr_lo = resonance[fc >> 3];
+    int32 fr_hi = resonance[(fc >> 3) + 1];
+    fr = (int)(fr_lo + ((((int64_t)fr_hi - fr_lo) * (fc & 7)) >> 3));
 #else
-        fr = CALC_RESONANCE_HP(f_freq);
+    if (mode & FILT_MODE_HP) fr = FixNo(CALC_RESONANCE_HP(fc / 8.0));
+    else fr = FixNo(CALC_RESONANCE_LP(fc / 8.0));
 #endif
 
-    // explanations see below.
-    arg = fr / (int)((isDSiMode() ? SAMPLE_FREQ_DSI : SAMPLE_FREQ) >> 1);
+    arg = fr / (filter_rate() >> 1);
 
     if (arg > FixNo(0.99)) {arg = FixNo(0.99);}
     if (arg < FixNo(0.01)) {arg = FixNo(0.01);}
 
-    g2 = FixNo(0.55) + FixNo(1.2) * arg * (arg - 1) + FixNo(0.0133333333) * f_res;
-    g1 = FixNo(-2) * g2.sqrt() * fixcos(arg);
+    g2 = FixNo(0.55) + FixNo(1.2) * arg * (arg - 1);
+    f_cos = fixcos(arg);
+    f_notch = (1 + fixcos(arg)) / fixsin(arg);
+}
 
-    if (f_type == FILT_LPBP || f_type == FILT_HPBP) {g2 += FixNo(0.1);}
 
-    if (g1.abs() >= g2 + 1)
+/*
+ *  Build the per-cutoff filter tables for the given FILT_MODE_xxx and
+ *  invalidate all of the g1 entries computed for the previous mode.
+ *  The g2/cos/notch points only follow the resonance curve, so a
+ *  bandpass-only change keeps them and just drops the g1 entries.
+ */
+
+void DigitalRenderer::build_filter_table(uint8 mode)
+{
+    if (f_table_mode == FILT_MODE_INVALID || ((mode ^ f_table_mode) & FILT_MODE_HP))
     {
-      if (g1 > 0) {g1 = g2 + FixNo(0.99);}
-      else {g1 = -(g2 + FixNo(0.99));}
+        for (int fc=0; fc<FILT_TABLE_FC; fc++)
+        {
+            calc_filter_point(mode, fc, filt_g2_table[fc], filt_cos_table[fc], filt_notch_table[fc]);
+        }
     }
 
-    switch (f_type)
+    memset(filt_g1_table, 0x7F, sizeof(filt_g1_table));    // All entries FILT_G1_EMPTY
+    f_table_mode = mode;
+}
+
+
+/*
+ *  Calculate IIR filter coefficients
+ */
+
+void DigitalRenderer::calc_filter(DRChip *ch)
+{
+    if (ch->f_type == FILT_ALL)
+    {
+        ch->d1 = 0; ch->d2 = 0; ch->g1 = 0; ch->g2 = 0; ch->f_ampl = FixNo(1); return;
+    }
+    else if (ch->f_type == FILT_NONE)
+    {
+        ch->d1 = 0; ch->d2 = 0; ch->g1 = 0; ch->g2 = 0; ch->f_ampl = 0; return;
+    }
+
+    uint8 mode = ((ch->f_type == FILT_LP || ch->f_type == FILT_LPBP) ? 0 : FILT_MODE_HP) |
+                 ((ch->f_type == FILT_LPBP || ch->f_type == FILT_HPBP) ? FILT_MODE_BP : 0);
+
+    // The tables follow the first SID. The second one only takes them over while the
+    // first has its filter out of the way - otherwise two chips on different resonance
+    // curves would rebuild them on every write and the second computes its point directly.
+    bool table_owner = (ch == &chip[0]) || (chip[0].f_type == FILT_NONE) || (chip[0].f_type == FILT_ALL);
+    if (mode != f_table_mode && table_owner)
+    {
+        build_filter_table(mode);
+    }
+
+    int fc = (ch->f_freq << 3) | ch->f_freq_low;
+
+    FixPoint g2_base, f_cos, f_notch;
+    int16 *g1_entry = NULL;
+    if (f_table_mode != FILT_MODE_INVALID && !((mode ^ f_table_mode) & FILT_MODE_HP))
+    {
+        g2_base = filt_g2_table[fc];
+        f_cos = filt_cos_table[fc];
+        f_notch = filt_notch_table[fc];
+        if (mode == f_table_mode) g1_entry = &filt_g1_table[ch->f_res][fc];    // g1 is clamped differently with BP mixed in
+    }
+    else
+    {
+        calc_filter_point(mode, fc, g2_base, f_cos, f_notch);
+    }
+
+    FixPoint g2_new = g2_base + FixNo(0.0133333333) * ch->f_res;
+    if (mode & FILT_MODE_BP) {g2_new += FixNo(0.1);}
+
+    int16 g1_fix = g1_entry ? *g1_entry : FILT_G1_EMPTY;
+    if (g1_fix == FILT_G1_EMPTY)
+    {
+        FixPoint g1_new = FixNo(-2) * (g2_base + FixNo(0.0133333333) * ch->f_res).sqrt() * f_cos;
+
+        if (g1_new.abs() >= g2_new + 1)
+        {
+          if (g1_new > 0) {g1_new = g2_new + FixNo(0.99);}
+          else {g1_new = -(g2_new + FixNo(0.99));}
+        }
+        g1_fix = (int)g1_new >> 2;
+        if (g1_entry) *g1_entry = g1_fix;
+    }
+
+    FixPoint g1 = g1_fix * 4;
+    FixPoint g2 = g2_new;
+    ch->g1 = g1;
+    ch->g2 = g2;
+
+    switch (ch->f_type)
     {
       case FILT_LPBP:
       case FILT_LP:
-        d1 = FixNo(2); d2 = FixNo(1); f_ampl = FixNo(0.25) * (1 + g1 + g2); break;
+        ch->d1 = FixNo(2); ch->d2 = FixNo(1); ch->f_ampl = FixNo(0.25) * (1 + g1 + g2); break;
       case FILT_HPBP:
       case FILT_HP:
-        d1 = FixNo(-2); d2 = FixNo(1); f_ampl = FixNo(0.25) * (1 - g1 + g2); break;
+        ch->d1 = FixNo(-2); ch->d2 = FixNo(1); ch->f_ampl = FixNo(0.25) * (1 - g1 + g2); break;
       case FILT_BP:
-        d1 = 0; d2 = FixNo(-1);
+        ch->d1 = 0; ch->d2 = FixNo(-1);
         {
         FixPoint c = fixsqrt(g2*g2 + FixNo(2.0)*g2 - g1*g1 + FixNo(1.0));
-        f_ampl = FixNo(0.25) * (FixNo(-2.0)*g2*g2 - (FixNo(4.0)+FixNo(2.0)*c)*g2 - FixNo(2.0)*c + (c+FixNo(2.0))*g1*g1 - FixNo(2.0)) / (-g2*g2 - (c+FixNo(2.0))*g2 - c + g1*g1 - FixNo(1.0));
+        ch->f_ampl = FixNo(0.25) * (FixNo(-2.0)*g2*g2 - (FixNo(4.0)+FixNo(2.0)*c)*g2 - FixNo(2.0)*c + (c+FixNo(2.0))*g1*g1 - FixNo(2.0)) / (-g2*g2 - (c+FixNo(2.0))*g2 - c + g1*g1 - FixNo(1.0));
         }
 
         break;
       case FILT_NOTCH:
-        d1 = FixNo(-2) * fixcos(arg); d2 = FixNo(1);
-        f_ampl = FixNo(0.25) * (1 + g1 + g2) * (1 + fixcos(arg)) / fixsin(arg);
+        ch->d1 = FixNo(-2) * f_cos; ch->d2 = FixNo(1);
+        ch->f_ampl = FixNo(0.25) * (1 + g1 + g2) * f_notch;
         break;
       default: break;
     }
@@ -854,154 +1160,228 @@ void DigitalRenderer::calc_filter(void)
 
 ITCM_CODE int16 DigitalRenderer::calc_buffer(int16 *buf, long count)
 {
-    // Get filter coefficients, so the emulator won't change
-    // them in the middle of our calculations
-    FixPoint cf_ampl = f_ampl;
-    FixPoint cd1 = d1, cd2 = d2, cg1 = g1, cg2 = g2;
+    int samples = (count >> 1) << os_shift;
+
+    for (int c=0; c<n_chips; c++)
+    {
+        DRChip *ch = &chip[c];
+
+        // Get filter coefficients, so the emulator won't change
+        // them in the middle of our calculations
+        FixPoint tf_ampl = ch->f_ampl;
+        FixPoint td1 = ch->d1, td2 = ch->d2, tg1 = ch->g1, tg2 = ch->g2;
+
+        // A change of filter type resets the filter state so there is nothing to ramp from
+        if (ch->f_snap)
+        {
+            ch->r_ampl = tf_ampl; ch->r_d1 = td1; ch->r_d2 = td2; ch->r_g1 = tg1; ch->r_g2 = tg2;
+            ch->f_snap = false;
+        }
+
+        // Linear ramp from the coefficients we finished the last buffer with to the new
+        // ones across this buffer - abrupt coefficient steps are heard as zipper noise.
+        ch->s_ampl = 0; ch->s_d1 = 0; ch->s_d2 = 0; ch->s_g1 = 0; ch->s_g2 = 0;
+        if (count >= 4)
+        {
+            ch->s_ampl = (tf_ampl - ch->r_ampl) / samples;
+            ch->s_d1 = (td1 - ch->r_d1) / samples; ch->s_d2 = (td2 - ch->r_d2) / samples;
+            ch->s_g1 = (tg1 - ch->r_g1) / samples; ch->s_g2 = (tg2 - ch->r_g2) / samples;
+        }
+    }
+
+    // Lines of sample_vol_filt[] per output sample - 16.16 fixed
+    int32 nominal_step = ((TOTAL_RASTERS_PAL * SCREEN_FREQ_PAL) << 16) / (isDSiMode() ? SAMPLE_FREQ_DSI : SAMPLE_FREQ);
+    int32 lines_needed = ((count >> 1) * nominal_step) >> 16;
+
+    // How far the reader trails the writer - resync on an underrun or overrun
+    int32 distance = (sample_in_ptr - (int32)(sample_out_ptr >> 16) + SAMPLE_BUF_SIZE) % SAMPLE_BUF_SIZE;
+    if ((distance < lines_needed) || (distance > (SAMPLE_BUF_SIZE - lines_needed)))
+    {
+        if (distance < lines_needed) sid_underruns++; else sid_overruns++;
+        distance = SAMPLE_BUF_SIZE/2;
+        sample_out_ptr = ((sample_in_ptr + (SAMPLE_BUF_SIZE/2)) % SAMPLE_BUF_SIZE) << 16;
+    }
+    sid_distance = distance;
+
+    // Nudge the step to bring the distance back to the centre of the buffer
+    int32 sample_step = nominal_step + ((nominal_step >> SAMPLE_STEP_NUDGE_SHIFT) * (distance - (SAMPLE_BUF_SIZE/2))) / (SAMPLE_BUF_SIZE/2);
+    sample_step >>= os_shift;
 
     // Index in sample_vol_filt[] for reading, 16.16 fixed
-    uint32 sample_count = (sample_in_ptr + (SAMPLE_BUF_SIZE/2)) << 16;
+    uint32 sample_count = sample_out_ptr;
 
     // Output DC offset
  	int32_t dc_offset = 0x100000;
 
+    // Both chips are mixed down into the one mono stream - keep a second SID from clipping
+    int mix_shift = 12 + n_chips;
+
     count >>= 1;    // 16 bit mono output, count is in bytes
+    count <<= os_shift;
+    int os_phase = 0;
 
     while (count--)
     {
-		// Get current master volume and RES/FILT setting from sample buffers
- 		uint8_t master_volume = sample_vol_filt[(sample_count >> 16) % SAMPLE_BUF_SIZE] & 0xf;
- 		uint8_t res_filt = sample_vol_filt[(sample_count >> 16) % SAMPLE_BUF_SIZE] >> 4;
+        // Get current master volume and RES/FILT setting of the first SID from sample buffers
+        uint8_t vol_filt = sample_vol_filt[(sample_count >> 16) % SAMPLE_BUF_SIZE];
 
         // calculate sampled voice
-        sample_count += ((TOTAL_RASTERS_PAL * SCREEN_FREQ_PAL) << 16) / (isDSiMode() ? SAMPLE_FREQ_DSI : SAMPLE_FREQ);
-        int32_t sum_output = 0;
-        int32 sum_output_filter = 0;
+        sample_count += sample_step;
+        int32_t ext_output = 0;
 
-        // Loop for all three voices
-        for (int j=0; j<3; j++)
+        for (int c=0; c<n_chips; c++)
         {
-            DRVoice *v = &voice[j];
-
-            // Envelope generator
-            uint16 envelope;
-
-            switch (v->eg_state) {
-                case EG_ATTACK:
-                    v->eg_level += v->a_add;
-                    if (v->eg_level > 0xffffff) {
-                        v->eg_level = 0xffffff;
-                        v->eg_state = EG_DECAY_SUSTAIN;
-                    }
-                    break;
-                case EG_DECAY_SUSTAIN:
-                    v->eg_level -= v->d_sub >> EGDRShift[v->eg_level >> 16];
-                    if (v->eg_level < v->s_level) {
-                        v->eg_level = v->s_level;
-                    }
-                    break;
-                case EG_RELEASE:
-                    v->eg_level -= v->r_sub >> EGDRShift[v->eg_level >> 16];
-                    if (v->eg_level < 0) {
-                        v->eg_level = 0;
-                    }
-                    break;
-            }
-            envelope = v->eg_level >> 16;
+            DRChip *ch = &chip[c];
 
-            // Waveform generator
-            if (v->mute)
-                continue;
-            uint16 output;
+            // The second SID plays from its current registers - digis on it are not sampled per line
+            uint8_t master_volume = c ? ch->volume : (vol_filt & 0xf);
+            uint8_t res_filt = c ? (ch->res_filt & 7) : (vol_filt >> 4);
+            int32_t sum_output = 0;
+            int32 sum_output_filter = 0;
 
-            if (!v->test)
-                v->count += v->add;
+            // Loop for the three voices of this chip
+            for (int j=0; j<3; j++)
+            {
+                DRVoice *v = &voice[c*3 + j];
+
+                // Envelope generator
+                uint16 envelope;
+
+                switch (v->eg_state) {
+                    case EG_ATTACK:
+                        v->eg_level += v->a_add;
+                        if (v->eg_level > 0xffffff) {
+                            v->eg_level = 0xffffff;
+                            v->eg_state = EG_DECAY_SUSTAIN;
+                        }
+                        break;
+                    case EG_DECAY_SUSTAIN:
+                        v->eg_level -= v->d_sub >> EGDRShift[v->eg_level >> 16];
+                        if (v->eg_level < v->s_level) {
+                            v->eg_level = v->s_level;
+                        }
+                        break;
+                    case EG_RELEASE:
+                        v->eg_level -= v->r_sub >> EGDRShift[v->eg_level >> 16];
+                        if (v->eg_level < 0) {
+                            v->eg_level = 0;
+                        }
+                        break;
+                }
+                envelope = v->eg_level >> 16;
 
-            if (v->sync && (v->count > 0x1000000))
-                v->mod_to->count = 0;
+                // Waveform generator
+                if (v->mute)
+                    continue;
+                uint16 output;
 
-            v->count &= 0xffffff;
+                if (!v->test)
+                    v->count += v->add;
 
-            switch (v->wave)
-            {
-                case WAVE_TRI: {
-                        uint32_t ctrl = v->count;
-                        if (v->ring) {
-                            ctrl ^= v->mod_by->count;
+                if (v->sync && (v->count > 0x1000000))
+                    v->mod_to->count = 0;
+
+                v->count &= 0xffffff;
+
+                switch (v->wave)
+                {
+                    case WAVE_TRI: {
+                            uint32_t ctrl = v->count;
+                            if (v->ring) {
+                                ctrl ^= v->mod_by->count;
+                            }
+                            if (ctrl & 0x800000) {
+                                output = (v->count >> 7) ^ 0xffff;
+                            } else {
+                                output = v->count >> 7;
+                            }
                         }
-                        if (ctrl & 0x800000) {
-                            output = (v->count >> 7) ^ 0xffff;
-                        } else {
-                            output = v->count >> 7;
+                        break;
+                    case WAVE_SAW:
+                        output = v->count >> 8;
+                        break;
+                    case WAVE_RECT:
+                        if (v->test || v->count >= (uint32_t)(v->pw << 12))
+                            output = 0xffff;
+                        else
+                            output = 0;
+                        break;
+                    case WAVE_TRISAW:
+                        output = ((u16*) 0x068A0000)[v->count >> 16];
+                        break;
+                    case WAVE_TRIRECT:
+                        if (v->test || v->count >= (uint32_t)(v->pw << 12))
+                        {
+                            uint32_t ctrl = v->count;
+                            if (v->ring)
+                            {
+                                ctrl ^= ~(v->mod_by->count) & 0x800000;
+                            }
+                            output = TriRectTable[ctrl >> 16];
                         }
-                    }
-                    break;
-                case WAVE_SAW:
-                    output = v->count >> 8;
-                    break;
-                case WAVE_RECT:
-                    if (v->test || v->count >= (uint32_t)(v->pw << 12))
-                        output = 0xffff;
-                    else
-                        output = 0;
-                    break;
-                case WAVE_TRISAW:
-                    output = ((u16*) 0x068A0000)[v->count >> 16];
-                    break;
-                case WAVE_TRIRECT:
-                    if (v->test || v->count >= (uint32_t)(v->pw << 12))
-                    {
-                        uint32_t ctrl = v->count;
-                        if (v->ring)
+                        else
                         {
-                            ctrl ^= ~(v->mod_by->count) & 0x800000;
+                            output = 0;
                         }
-                        output = TriRectTable[ctrl >> 16];
-                    }
-                    else
-                    {
-                        output = 0;
-                    }
-                    break;
-                case WAVE_SAWRECT:
-                    if (v->test || v->count >= (uint32_t)(v->pw << 12))
-                        output = ((u16*) 0x068A2000)[v->count >> 16];
-                    else
-                        output = 0;
-                    break;
-                case WAVE_TRISAWRECT:
-                    if (v->test || v->count >= (uint32_t)(v->pw << 12))
-                        output = ((u16*) 0x068A3000)[v->count >> 16];
-                    else
-                        output = 0;
-                    break;
-                case WAVE_NOISE:
-                    if (v->count > 0x100000) {
-                        output = v->noise = sid_random() << 8;
-                        v->count &= 0xfffff;
-                    } else
-                        output = v->noise;
-                    break;
-                default:
-                    output = 0x8000;
-                    break;
+                        break;
+                    case WAVE_SAWRECT:
+                        if (v->test || v->count >= (uint32_t)(v->pw << 12))
+                            output = ((u16*) 0x068A2000)[v->count >> 16];
+                        else
+                            output = 0;
+                        break;
+                    case WAVE_TRISAWRECT:
+                        if (v->test || v->count >= (uint32_t)(v->pw << 12))
+                            output = ((u16*) 0x068A3000)[v->count >> 16];
+                        else
+                            output = 0;
+                        break;
+                    case WAVE_NOISE:
+                        if (v->count > 0x100000) {
+                            output = v->noise = sid_random() << 8;
+                            v->count &= 0xfffff;
+                        } else
+                            output = v->noise;
+                        break;
+                    default:
+                        output = 0x8000;
+                        break;
+                }
+
+                // Route voice through filter if selected
+                if (res_filt & (1 << j))
+                    sum_output_filter += (int16)(output ^ 0x8000) * envelope;
+                else
+                    sum_output += (int16)(output ^ 0x8000) * envelope;
             }
 
-            // Route voice through filter if selected
- 			if (res_filt & (1 << j))
-                sum_output_filter += (int16)(output ^ 0x8000) * envelope;
-            else
-                sum_output += (int16)(output ^ 0x8000) * envelope;
-        }
+            // Filter
+            ch->r_ampl += ch->s_ampl; ch->r_d1 += ch->s_d1; ch->r_d2 += ch->s_d2; ch->r_g1 += ch->s_g1; ch->r_g2 += ch->s_g2;
+            int32 xn = ch->r_ampl.imul(sum_output_filter);
+            int32 yn = xn+ch->r_d1.imul(ch->xn1)+ch->r_d2.imul(ch->xn2)-ch->r_g1.imul(ch->yn1)-ch->r_g2.imul(ch->yn2);
+            ch->yn2 = ch->yn1; ch->yn1 = yn; ch->xn2 = ch->xn1; ch->xn1 = xn;
+            sum_output_filter = yn;
 
-        // Filter
-        int32 xn = cf_ampl.imul(sum_output_filter);
-        int32 yn = xn+cd1.imul(xn1)+cd2.imul(xn2)-cg1.imul(yn1)-cg2.imul(yn2);
-        yn2 = yn1; yn1 = yn; xn2 = xn1; xn1 = xn;
-        sum_output_filter = yn;
+            ext_output += (sum_output - sum_output_filter + dc_offset) * master_volume;
+        }
+        ext_output >>= mix_shift;
 
-        int32_t ext_output = (sum_output - sum_output_filter + dc_offset) * master_volume;
-        ext_output >>= 13;
+        // Oversampled - feed the decimation filter and only output every Nth sample
+        if (os_shift)
+        {
+            fir_hist[fir_pos] = fir_hist[fir_pos + FIR_TAPS] = ext_output;
+            fir_pos = (fir_pos + 1) & (FIR_TAPS - 1);
+            if (++os_phase < (1 << os_shift)) continue;
+            os_phase = 0;
+
+            int32 *x = &fir_hist[fir_pos];
+            int32 acc = 0;
+            for (int k=0; k<FIR_TAPS/2; k++)
+            {
+                acc += FIRTable[k] * (x[k] + x[FIR_TAPS-1-k]);
+            }
+            ext_output = acc >> 14;
+        }
 
 		// Write to buffer
         if (ext_output & 0xFFFF8000) // Check clipping only if some high bits are set...
@@ -1018,6 +1398,15 @@ ITCM_CODE int16 DigitalRenderer::calc_buffer(int16 *buf, long count)
 
         *buf++ = ext_output;
     }
+
+    sample_out_ptr = sample_count % (SAMPLE_BUF_SIZE << 16);
+
+    // Land exactly on the target coefficients - the ramp steps are truncated
+    for (int c=0; c<n_chips; c++)
+    {
+        DRChip *ch = &chip[c];
+        ch->r_ampl = ch->f_ampl; ch->r_d1 = ch->d1; ch->r_d2 = ch->d2; ch->r_g1 = ch->g1; ch->r_g2 = ch->g2;
+    }
     buf--; return *buf;
 }
 
@@ -1078,18 +1467,30 @@ DigitalRenderer::~DigitalRenderer()
 
 void DigitalRenderer::EmulateLine(void)
 {
-    sample_vol_filt[sample_in_ptr] = volume | ((res_filt & 7) << 4);
+    if (sid_on_arm7)
+    {
+        if (++sid_line == SID7_LINES_PER_FRAME)
+        {
+            sid_line = 0;
+            fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_FRAME, ++sid_frame));
+        }
+        return;
+    }
+
+    sample_vol_filt[sample_in_ptr] = chip[0].volume | ((chip[0].res_filt & 7) << 4);
     sample_in_ptr = (sample_in_ptr + 1) % SAMPLE_BUF_SIZE;
 }
 
 void DigitalRenderer::Pause(void)
 {
     paused = true;
+    if (sid_on_arm7) fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_PAUSE, 0));
 }
 
 void DigitalRenderer::Resume(void)
 {
     paused = false;
+    if (sid_on_arm7) fifoSendValue32(FIFO_SID7, SID7_MSG_COMMAND(SID7_CMD_RESUME, 0));
 }
 
 
@@ -1119,7 +1520,7 @@ void MOS6581::open_close_renderer(int old_type, int new_type)
  */
 uint8_t MOS6581::read_osc3() const
  {
-    uint8_t v3_ctrl = regs[0x12];   // Voice 3 control register
+    uint8_t v3_ctrl = sid_regs[0x12];   // Voice 3 control register
     if (v3_ctrl & 0x10) {           // Triangle wave
         // TODO: ring modulation from voice 2
         if (fake_v3_count & 0x800000) {
@@ -1130,7 +1531,7 @@ uint8_t MOS6581::read_osc3() const
     } else if (v3_ctrl & 0x20) {    // Sawtooth wave
         return fake_v3_count >> 16;
     } else if (v3_ctrl & 0x40) {    // Rectangle wave
-        uint32_t pw = ((regs[0x11] & 0x0f) << 8) | regs[0x10];
+        uint32_t pw = ((sid_regs[0x11] & 0x0f) << 8) | sid_regs[0x10];
         if (fake_v3_count > (pw << 12)) {
             return 0xff;
         } else {
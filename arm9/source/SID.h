@@ -41,9 +41,14 @@
 #include <stdlib.h>
 
 extern uint8 regs[32];
+extern uint8 regs2[32];
 extern uint8 last_sid_byte;
+extern uint32 sid_underruns;      // Sound callback caught up with the emulation
+extern uint32 sid_overruns;       // Emulation about to lap the sound callback
+extern int32  sid_distance;       // Raster lines between the two at the last callback
 extern int16_t EGDivTable[16];    // Clock divisors for A/D/R settings
 extern uint8_t EGDRShift[256];    // For exponential approximation of D/R
+extern uint8 bRunAhead;           // Frames being run ahead must not be heard
 
 class DrivePrefs;
 class C64;
@@ -57,11 +62,19 @@ enum {
     SIDTYPE_SIDCARD     // SID card
 };
 
+// Second SID mapping - myConfig.sid2Addr
+enum {
+    SID2_NONE,          // Just the one SID
+    SID2_D420,          // $D420 - every other 32 byte mirror of the SID area
+    SID2_D500,          // $D500 - the $D500 page mirrors
+    SID2_DE00           // $DE00 - cartridge I/O 1
+};
+
 
 // Class for administrative functions
 class MOS6581 {
 public:
-    MOS6581(C64 *c64);
+    MOS6581(C64 *c64, MOS6581 *first = NULL);
     ~MOS6581();
 
     void Reset(void);
@@ -77,7 +90,9 @@ private:
     void open_close_renderer(int old_type, int new_type);
 
     C64 *the_c64;               // Pointer to C64 object
-    SIDRenderer *the_renderer;  // Pointer to current renderer
+    SIDRenderer *the_renderer;  // Pointer to current renderer - the second SID shares the first one's
+    uint8 *sid_regs;            // Copies of our registers - regs[] or regs2[]
+    uint8 reg_base;             // Offset of our registers in the renderer - 0, or 32 for the second SID
     uint32_t fake_v3_count;     // Fake voice 3 phase accumulator for oscillator read-back
     int32_t fake_v3_eg_level;   // Fake voice 3 EG level (8.16 fixed) for EG read-back
     int16   fake_v3_eg_state;   // Fake voice 3 EG state
@@ -162,13 +177,13 @@ struct MOS6581State {
 inline void MOS6581::EmulateLine(int cycles)
 {
     // Simulate voice 3 phase accumulator
-    if (regs[0x12] & 0x08)  // Voice 3 control register
+    if (sid_regs[0x12] & 0x08)  // Voice 3 control register
     {
         fake_v3_count = 0;
     } 
     else 
     {
-        uint32_t add = (regs[0x0f] << 8) | regs[0x0e];
+        uint32_t add = (sid_regs[0x0f] << 8) | sid_regs[0x0e];
         fake_v3_count = (fake_v3_count + add * 63) & 0xffffff;
     }
 
@@ -176,7 +191,7 @@ inline void MOS6581::EmulateLine(int cycles)
     switch (fake_v3_eg_state) 
     {
         case EG_ATTACK:
-            fake_v3_eg_level +=  (cycles << 16) / EGDivTable[regs[0x13] >> 4];
+            fake_v3_eg_level +=  (cycles << 16) / EGDivTable[sid_regs[0x13] >> 4];
             if (fake_v3_eg_level > 0xffffff)
             {
                 fake_v3_eg_level = 0xffffff;
@@ -185,8 +200,8 @@ inline void MOS6581::EmulateLine(int cycles)
             break;
         case EG_DECAY_SUSTAIN: 
         {
-            int32_t s_level = (regs[0x14] >> 4) * 0x111111;
-            fake_v3_eg_level -= ((cycles << 16) / EGDivTable[regs[0x13] & 0x0f]) >> EGDRShift[fake_v3_eg_level >> 16];
+            int32_t s_level = (sid_regs[0x14] >> 4) * 0x111111;
+            fake_v3_eg_level -= ((cycles << 16) / EGDivTable[sid_regs[0x13] & 0x0f]) >> EGDRShift[fake_v3_eg_level >> 16];
             if (fake_v3_eg_level < s_level) 
             {
                 fake_v3_eg_level = s_level;
@@ -196,7 +211,7 @@ inline void MOS6581::EmulateLine(int cycles)
         case EG_RELEASE:
             if (fake_v3_eg_level != 0) 
             {
-                fake_v3_eg_level -= ((cycles << 16) / EGDivTable[regs[0x14] & 0x0f]) >> EGDRShift[fake_v3_eg_level >> 16];
+                fake_v3_eg_level -= ((cycles << 16) / EGDivTable[sid_regs[0x14] & 0x0f]) >> EGDRShift[fake_v3_eg_level >> 16];
                 if (fake_v3_eg_level < 0) 
                 {
                     fake_v3_eg_level = 0;
@@ -205,7 +220,7 @@ inline void MOS6581::EmulateLine(int cycles)
             break;
     }
     
-    if (the_renderer != NULL)
+    if (the_renderer != NULL && !reg_base && !bRunAhead)
     {
         the_renderer->EmulateLine();
     }
@@ -250,7 +265,7 @@ inline void MOS6581::WriteRegister(uint16 adr, uint8 byte)
     // Handle fake voice 3 EG state
     if (adr == 0x12) {  // Voice 3 control register
         uint8_t gate = byte & 0x01;
-        if ((regs[0x12] & 0x01) != gate) {
+        if ((sid_regs[0x12] & 0x01) != gate) {
             if (gate) {     // Gate turned on
                 fake_v3_eg_state = EG_ATTACK;
             } else {        // Gate turned off
@@ -260,10 +275,10 @@ inline void MOS6581::WriteRegister(uint16 adr, uint8 byte)
     }    
     
     // Keep a local copy of the register values
-    last_sid_byte = regs[adr] = byte;
+    last_sid_byte = sid_regs[adr] = byte;
 
-    if (the_renderer != NULL)
-        the_renderer->WriteRegister(adr, byte);
+    if (the_renderer != NULL && !bRunAhead)
+        the_renderer->WriteRegister(adr + reg_base, byte);
 }
 
 #endif
@@ -530,6 +530,16 @@ void MOS6569::SetState(MOS6569State *vd)
 }
 
 
+/*
+ *  Override whether the rest of the current frame is drawn (run-ahead)
+ */
+
+void MOS6569::SkipFrame(bool skip)
+{
+    frame_skipped = skip;
+}
+
+
 /*
  *  Trigger raster IRQ
  */
@@ -841,6 +851,8 @@ inline void MOS6569::vblank(void)
         if ((total_frames % 3) == 0) frame_skipped = 0; // But toss in the odd frame to smooth out the display
     }
 
+    if (bAutoWarp) frame_skipped = (total_frames & 7); // Only draw every 8th frame while warping through a load
+
     the_c64->VBlank(!frame_skipped);
     the_c64->TheCPU->VBlank();
 }
@@ -84,6 +84,7 @@ public:
     void TriggerLightpen(void);     // Trigger lightpen interrupt
     void GetState(MOS6569State *vd);
     void SetState(MOS6569State *vd);
+    void SkipFrame(bool skip);      // Override the frame skip for the rest of this frame
     void Reset(void);
 
 private:
@@ -278,7 +278,7 @@ void gimliDSFindFiles(u8 bCartOnly)
         }
         else
         {
-            if ( (strcasecmp(strrchr(szFile, '.'), ".D64") == 0) )
+            if ( (strcasecmp(strrchr(szFile, '.'), ".D64") == 0) || (strcasecmp(strrchr(szFile, '.'), ".G64") == 0) )
             {
               strcpy(gpFic[uNbFile].szName,szFile);
               gpFic[uNbFile].uType = NORMALFILE;
@@ -0,0 +1,105 @@
+// =====================================================================================
+// GimliDS Copyright (c) 2025-2026 Dave Bernazzani (wavemotion-dave)
+//
+// As GimliDS is a port of the Frodo emulator for the DS/DSi/XL/LL handhelds,
+// any copying or distribution of this emulator, its source code and associated
+// readme files, with or without modification, are permitted per the original
+// Frodo emulator license shown below.  Hugest thanks to Christian Bauer for his
+// efforts to provide a clean open-source emulation base for the C64.
+//
+// Numerous hacks and 'unsafe' optimizations have been performed on the original
+// Frodo emulator codebase to get it running on the small handheld system. You
+// are strongly encouraged to seek out the official Frodo sources if you're at
+// all interested in this emulator code.
+//
+// The GimliDS emulator is offered as-is, without any warranty. Please see readme.md
+// =====================================================================================
+
+// Streaming lzav compression - fixed 16K windows straight to and from a FILE
+
+#include <nds.h>
+#include <stdio.h>
+#include <string.h>
+#include "lzavstream.h"
+#include "lzav.h"
+#include "mainmenu.h"
+
+// Room for the worst case of either compressor on a full window
+static u8 window_buf[LZAV_STREAM_WINDOW + LZAV_STREAM_WINDOW/16 + 64];
+
+int lzav_stream_window(FILE *f, const void *src, int len, bool hi, u32 *crc)
+{
+    if (len <= 0 || len > LZAV_STREAM_WINDOW) return -1;
+
+    int comp_len = hi ? lzav_compress_hi(src, window_buf, len, sizeof(window_buf))
+                      : lzav_compress_default(src, window_buf, len, sizeof(window_buf));
+
+    u8 *stored = window_buf;
+    u16 hdr_len = comp_len;
+    if (comp_len <= 0 || comp_len >= len)   // Didn't pay off - store it as is
+    {
+        stored = (u8 *)src;
+        comp_len = len;
+        hdr_len = len | LZAV_STREAM_RAW;
+    }
+
+    u8 hdr[2] = {(u8)(hdr_len & 0xFF), (u8)(hdr_len >> 8)};
+    if (fwrite(hdr, sizeof(hdr), 1, f) != 1) return -1;
+    if (fwrite(stored, comp_len, 1, f) != 1) return -1;
+
+    if (crc)
+    {
+        *crc = updateCRC32(*crc, hdr, sizeof(hdr));
+        *crc = updateCRC32(*crc, stored, comp_len);
+    }
+    return sizeof(hdr) + comp_len;
+}
+
+int lzav_stream_write(FILE *f, const void *src, int len, bool hi, u32 *crc)
+{
+    const u8 *p = (const u8 *)src;
+    int written = 0;
+
+    while (len > 0)
+    {
+        int n = (len > LZAV_STREAM_WINDOW) ? LZAV_STREAM_WINDOW : len;
+        int w = lzav_stream_window(f, p, n, hi, crc);
+        if (w < 0) return -1;
+        written += w;
+        p += n;
+        len -= n;
+    }
+    return written;
+}
+
+bool lzav_stream_read(FILE *f, void *dst, int len, int stored, u32 *crc)
+{
+    u8 *p = (u8 *)dst;
+
+    while (len > 0)
+    {
+        u8 hdr[2];
+        if (stored < (int)sizeof(hdr) || fread(hdr, sizeof(hdr), 1, f) != 1) return false;
+        stored -= sizeof(hdr);
+
+        int n = (len > LZAV_STREAM_WINDOW) ? LZAV_STREAM_WINDOW : len;
+        int win_len = (hdr[0] | (hdr[1] << 8)) & ~LZAV_STREAM_RAW;
+        bool raw = (hdr[1] << 8) & LZAV_STREAM_RAW;
+        if (win_len > stored || win_len > (int)sizeof(window_buf) || (raw && win_len != n)) return false;
+
+        u8 *to = raw ? p : window_buf;
+        if (fread(to, win_len, 1, f) != 1) return false;
+        stored -= win_len;
+
+        if (crc)
+        {
+            *crc = updateCRC32(*crc, hdr, sizeof(hdr));
+            *crc = updateCRC32(*crc, to, win_len);
+        }
+        if (!raw && lzav_decompress(window_buf, p, win_len, n) != n) return false;
+
+        p += n;
+        len -= n;
+    }
+    return (stored == 0);
+}
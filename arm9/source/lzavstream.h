@@ -0,0 +1,41 @@
+// =====================================================================================
+// GimliDS Copyright (c) 2025-2026 Dave Bernazzani (wavemotion-dave)
+//
+// As GimliDS is a port of the Frodo emulator for the DS/DSi/XL/LL handhelds,
+// any copying or distribution of this emulator, its source code and associated
+// readme files, with or without modification, are permitted per the original
+// Frodo emulator license shown below.  Hugest thanks to Christian Bauer for his
+// efforts to provide a clean open-source emulation base for the C64.
+//
+// Numerous hacks and 'unsafe' optimizations have been performed on the original
+// Frodo emulator codebase to get it running on the small handheld system. You
+// are strongly encouraged to seek out the official Frodo sources if you're at
+// all interested in this emulator code.
+//
+// The GimliDS emulator is offered as-is, without any warranty. Please see readme.md
+// =====================================================================================
+
+// Streaming wrapper around lzav: data goes to and from a FILE in fixed 16K
+// windows, so no buffer bigger than one window is ever needed. Each window is
+// a 2-byte little-endian header - the stored length, with LZAV_STREAM_RAW set
+// when the window did not compress and is stored as is - followed by its data.
+
+#ifndef _LZAVSTREAM_H
+#define _LZAVSTREAM_H
+
+#include <nds.h>
+#include <stdio.h>
+
+#define LZAV_STREAM_WINDOW  (16*1024)
+#define LZAV_STREAM_RAW     0x8000
+
+// Compress and write one window of at most LZAV_STREAM_WINDOW bytes. Returns the bytes written or -1.
+extern int  lzav_stream_window(FILE *f, const void *src, int len, bool hi, u32 *crc);
+
+// Compress and write len bytes, a window at a time. Returns the bytes written or -1.
+extern int  lzav_stream_write(FILE *f, const void *src, int len, bool hi, u32 *crc);
+
+// Read back len bytes from 'stored' bytes of windows. Fails on a short read or a bad window.
+extern bool lzav_stream_read(FILE *f, void *dst, int len, int stored, u32 *crc);
+
+#endif
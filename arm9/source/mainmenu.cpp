@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <sys/stat.h>
 #include <sys/dir.h>
@@ -31,8 +32,10 @@
 #include "mainmenu.h"
 #include "mainmenu_bg.h"
 #include "1541d64.h"
+#include "SID.h"
 #include "Display.h"
 #include "lzav.h"
+#include "lzavstream.h"
 #include "printf.h"
 
 extern int bg0b, bg1b;
@@ -48,7 +51,7 @@ s16 CycleDeltas[] __attribute__((section(".dtcm"))) = {0,1,2,3,4,5,6,10,-2,-1};
 
 static u16 nds_key __attribute__((section(".dtcm")));
 
-extern u8 CompressBuffer[]; // Needed for config compression
+#define CONFIG_STREAMED 0x80000000  // Set in the stored length when AllConfigs is in lzav stream windows
 
 // ----------------------------------------------------------------------
 // The Disk Menu can be called up directly from the keyboard graphic
@@ -63,6 +66,12 @@ extern u8 CompressBuffer[]; // Needed for config compression
 #define MENU_ACTION_GLOBAL_CONFIG   5   // Global Config
 #define MENU_ACTION_LCD_SWAP        6   // Swap upper/lower LCD
 #define MENU_ACTION_QUIT_EMU        7   // Exit Emulator
+#define MENU_ACTION_QUICK_SLOT      8   // Pick the quick-save slot
+#define MENU_ACTION_QUICK_SAVE      9   // Quick-save to RAM
+#define MENU_ACTION_QUICK_LOAD      10  // Quick-load from RAM
+#define MENU_ACTION_QUICK_PERSIST   11  // Write the quick-save slot to SD
+#define MENU_ACTION_MOVIE_RECORD    12  // Start/stop recording a movie
+#define MENU_ACTION_MOVIE_PLAY      13  // Play back a movie
 #define MENU_ACTION_SKIP            99  // Skip this MENU choice
 
 typedef struct
@@ -75,16 +84,25 @@ typedef struct
 {
     char *title;
     u8   start_row;
-    MenuItem_t menulist[12];
+    MenuItem_t menulist[16];
 } MainMenu_t;
 
+static char quick_slot_str[] = "  QUICK    SLOT 1 ";
+static char movie_str[]      = "  RECORD   MOVIE  ";
+
 MainMenu_t main_menu =
 {
-    (char *)"MAIN MENU", 7,
+    (char *)"MAIN MENU", 2,
     {
         {(char *)"  CONFIG   GAME   ",      MENU_ACTION_CONFIG},
         {(char *)"  SAVE     STATE  ",      MENU_ACTION_SAVE_STATE},
         {(char *)"  LOAD     STATE  ",      MENU_ACTION_LOAD_STATE},
+        {quick_slot_str,                        MENU_ACTION_QUICK_SLOT},
+        {(char *)"  QUICK    SAVE   ",      MENU_ACTION_QUICK_SAVE},
+        {(char *)"  QUICK    LOAD   ",      MENU_ACTION_QUICK_LOAD},
+        {(char *)"  QUICK TO SD CARD",      MENU_ACTION_QUICK_PERSIST},
+        {movie_str,                             MENU_ACTION_MOVIE_RECORD},
+        {(char *)"  PLAY     MOVIE  ",      MENU_ACTION_MOVIE_PLAY},
         {(char *)"  GLOBAL   CONFIG ",      MENU_ACTION_GLOBAL_CONFIG},
         {(char *)"  LCD      SWAP   ",      MENU_ACTION_LCD_SWAP},
         {(char *)"  RESET    C64    ",      MENU_ACTION_RESET_EMU},
@@ -113,6 +131,7 @@ void MainMenuShow(bool bClearScreen, u8 sel)
     // Pick the right context menu based on the machine
     // ---------------------------------------------------
     menu = &main_menu;
+    strcpy(movie_str, (movie_mode == MOVIE_RECORDING) ? "  STOP     MOVIE  " : "  RECORD   MOVIE  ");
 
     // Display the menu title
     DSPrint(15-(strlen(menu->title)/2), menu->start_row, 0, menu->title);
@@ -135,6 +154,79 @@ void check_and_make_sav_directory(void)
   else mkdir("sav", 0777);   // Otherwise create the directory...
 }
 
+// Snapshot file for the current game into theDrivePath: sav/<name>.gss
+static void snapshot_path(void)
+{
+    check_and_make_sav_directory();
+    if (strlen(CartFilename) > 1) // Cart overrides disk
+    {
+        sprintf(theDrivePath,"sav/%s", CartFilename);
+    }
+    else
+    {
+        sprintf(theDrivePath,"sav/%s", TheDrivePrefs.DrivePath[0]);
+    }
+    int len = strlen(theDrivePath);
+    theDrivePath[len-3] = 'g';
+    theDrivePath[len-2] = 's';
+    theDrivePath[len-1] = 's';
+}
+
+// Show a short message on the menu for a moment
+static void menu_message(const char *msg)
+{
+    DSPrint(0, 18, 0, (char*)msg);
+    WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
+    WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
+    WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
+    DSPrint(0, 18, 0, (char*)"                               ");
+}
+
+
+// Preview the snapshot behind a LOAD item: the thumbnail over the paused C64
+// screen and when it was taken. This comes from the index (or the quick slot
+// in memory) - the .GSS file itself is not opened just to look at it.
+static void snapshot_preview(C64 *the_c64, u8 action)
+{
+    static SnapshotMeta meta;
+    static u8 thumb[SNAPSHOT_THUMB_SIZE];
+    char tmp[34];
+    bool found = false;
+
+    if (action == MENU_ACTION_LOAD_STATE)
+    {
+        if (file_crc != 0x00000000)
+        {
+            snapshot_path();
+            found = SnapshotIndexFind(theDrivePath, &meta, thumb);
+        }
+    }
+    else if (action == MENU_ACTION_QUICK_LOAD)
+    {
+        found = QuickSlotInfo(quick_slot, &meta, thumb);
+    }
+    else
+    {
+        the_c64->TheDisplay->ShowThumbnail(NULL);
+        DSPrint(0, 20, 0, (char*)"                               ");
+        return;
+    }
+
+    if (found)
+    {
+        time_t t = meta.time;
+        struct tm *tm = localtime(&t);
+        sprintf(tmp, "  SAVED %04d-%02d-%02d %02d:%02d %s  ", tm->tm_year+1900, tm->tm_mon+1, tm->tm_mday, tm->tm_hour, tm->tm_min, meta.true_drive ? "[TD]":"    ");
+        DSPrint(0, 20, 0, tmp);
+        the_c64->TheDisplay->ShowThumbnail(thumb);
+    }
+    else
+    {
+        DSPrint(0, 20, 0, (char*)"        NO SNAPSHOT SAVED      ");
+        the_c64->TheDisplay->ShowThumbnail(NULL);
+    }
+}
+
 
 // ------------------------------------------------------------------------
 // Handle Main Menu interface...
@@ -150,6 +242,15 @@ u8 MainMenu(C64 *the_c64)
   //Show the cassette menu background - we'll draw text on top of this
   // ------------------------------------------------------------------
   MainMenuShow(true, menuSelection);
+  snapshot_preview(the_c64, menu->menulist[menuSelection].menu_action);
+
+  // With STATE HASH on, the frame hashes so far go out to sav/<game>.hsh
+  if (myGlobalConfig.stateHash && file_crc != 0x00000000)
+  {
+      snapshot_path();
+      strcpy(theDrivePath + strlen(theDrivePath) - 3, "hsh");
+      if (the_c64->StateHashDump(theDrivePath)) menu_message("   STATE HASHES WRITTEN (.HSH) ");
+  }
 
   u8 bExitMenu = false;
   while (true)
@@ -166,6 +267,7 @@ u8 MainMenu(C64 *the_c64)
                 menuSelection = (menuSelection > 0) ? (menuSelection-1):(main_menu_items-1);
             }
             MainMenuShow(false, menuSelection);
+            snapshot_preview(the_c64, menu->menulist[menuSelection].menu_action);
         }
         if (nds_key & KEY_DOWN)
         {
@@ -175,6 +277,7 @@ u8 MainMenu(C64 *the_c64)
                 menuSelection = (menuSelection+1) % main_menu_items;
             }
             MainMenuShow(false, menuSelection);
+            snapshot_preview(the_c64, menu->menulist[menuSelection].menu_action);
         }
         if (nds_key & KEY_B) // Treat this as selecting 'exit'
         {
@@ -185,10 +288,12 @@ u8 MainMenu(C64 *the_c64)
             switch(menu->menulist[menuSelection].menu_action)
             {
                 case MENU_ACTION_QUIT_EMU:
+                    the_c64->FinishSnapshotSave();  // Don't walk away from a save still being written
                     exit(0);
                     break;
 
                 case MENU_ACTION_RESET_EMU:
+                    the_c64->MovieReset();
                     the_c64->RemoveCart();
                     the_c64->PatchKernal(TheDrivePrefs.TrueDrive);
                     the_c64->Reset();
@@ -201,6 +306,7 @@ u8 MainMenu(C64 *the_c64)
                     {
                         u8 last_trueDrive = myConfig.trueDrive;
                         GimliDSGameOptions();
+                        the_c64->TheSID->NewPrefs(&TheDrivePrefs);  // Pick up a second SID being mapped in or out
                         if (last_trueDrive != myConfig.trueDrive) // Need to reload...
                         {
                             DrivePrefs *prefs = new DrivePrefs(TheDrivePrefs);
@@ -230,31 +336,20 @@ u8 MainMenu(C64 *the_c64)
                 case MENU_ACTION_GLOBAL_CONFIG:
                     option_table = 1;
                     GimliDSGameOptions();
+                    the_c64->TheSID->NewPrefs(&TheDrivePrefs);  // Pick up any change to the SID quality
                     bExitMenu = true;
                     break;
 
                 case MENU_ACTION_SAVE_STATE:
                 {
-                    check_and_make_sav_directory();
-                    if (strlen(CartFilename) > 1) // Cart overrides disk
-                    {
-                        sprintf(theDrivePath,"sav/%s", CartFilename);
-                    }
-                    else
-                    {
-                        sprintf(theDrivePath,"sav/%s", TheDrivePrefs.DrivePath[0]);
-                    }
-                    int len = strlen(theDrivePath);
-                    theDrivePath[len-3] = 'g';
-                    theDrivePath[len-2] = 's';
-                    theDrivePath[len-1] = 's';
-                    if (the_c64->SaveSnapshot(theDrivePath) == false)
+                    snapshot_path();
+                    if (the_c64->StartSnapshotSave(theDrivePath) == false)
                     {
                         DSPrint(0, 18, 0, (char*)"      UNABLE TO SAVE STATE     ");
                     }
                     else
                     {
-                        DSPrint(0, 18, 0, (char*)"      .GSS SNAPSHOT SAVED      ");
+                        DSPrint(0, 18, 0, (char*)"    SAVING .GSS SNAPSHOT...    ");
                     }
                     WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
                     WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
@@ -266,19 +361,7 @@ u8 MainMenu(C64 *the_c64)
 
                 case MENU_ACTION_LOAD_STATE:
                 {
-                    check_and_make_sav_directory();
-                    if (strlen(CartFilename) > 1) // Cart overrides disk
-                    {
-                        sprintf(theDrivePath,"sav/%s", CartFilename);
-                    }
-                    else
-                    {
-                        sprintf(theDrivePath,"sav/%s", TheDrivePrefs.DrivePath[0]);
-                    }
-                    int len = strlen(theDrivePath);
-                    theDrivePath[len-3] = 'g';
-                    theDrivePath[len-2] = 's';
-                    theDrivePath[len-1] = 's';
+                    snapshot_path();
                     if (the_c64->LoadSnapshot(theDrivePath) == false)
                     {
                         DSPrint(0, 18, 0, (char*)"    NO VALID SNAPSHOT FOUND    ");
@@ -291,13 +374,67 @@ u8 MainMenu(C64 *the_c64)
                 }
                     break;
 
+                case MENU_ACTION_QUICK_SLOT:
+                    quick_slot = (quick_slot + 1) % 3;
+                    quick_slot_str[16] = '1' + quick_slot;
+                    MainMenuShow(false, menuSelection);
+                    break;
+
+                case MENU_ACTION_QUICK_SAVE:
+                    if (the_c64->QuickSave(quick_slot)) bExitMenu = true;
+                    else menu_message("     NOT ENOUGH MEMORY FREE    ");
+                    break;
+
+                case MENU_ACTION_QUICK_LOAD:
+                    if (the_c64->QuickLoad(quick_slot)) bExitMenu = true;
+                    else menu_message("     QUICK SLOT IS EMPTY       ");
+                    break;
+
+                case MENU_ACTION_QUICK_PERSIST:
+                    snapshot_path();
+                    if (the_c64->QuickPersist(quick_slot, theDrivePath)) menu_message("      .GSS SNAPSHOT SAVED      ");
+                    else menu_message("     QUICK SLOT IS EMPTY       ");
+                    break;
+
+                // Movies go to sav/<game>.gmv - recording starts from a snapshot of right now
+                case MENU_ACTION_MOVIE_RECORD:
+                    if (movie_mode == MOVIE_RECORDING)
+                    {
+                        the_c64->MovieStop();
+                        bExitMenu = true;
+                    }
+                    else if (file_crc == 0x00000000) menu_message("       NO GAME IS LOADED      ");
+                    else
+                    {
+                        snapshot_path();
+                        strcpy(theDrivePath + strlen(theDrivePath) - 3, "gmv");
+                        if (the_c64->MovieRecord(theDrivePath)) bExitMenu = true;
+                        else menu_message("     UNABLE TO RECORD MOVIE    ");
+                    }
+                    break;
+
+                case MENU_ACTION_MOVIE_PLAY:
+                    if (file_crc == 0x00000000) menu_message("       NO GAME IS LOADED      ");
+                    else
+                    {
+                        snapshot_path();
+                        strcpy(theDrivePath + strlen(theDrivePath) - 3, "gmv");
+                        if (the_c64->MoviePlay(theDrivePath)) bExitMenu = true;
+                        else menu_message("      NO VALID MOVIE FOUND     ");
+                    }
+                    break;
+
                 case MENU_ACTION_EXIT:
                     bExitMenu = true;
                     break;
             }
         }
 
-        if (bExitMenu) break;
+        if (bExitMenu)
+        {
+            the_c64->TheDisplay->ShowThumbnail(NULL);
+            break;
+        }
         while ((keysCurrent() & (KEY_UP | KEY_DOWN | KEY_A ))!=0);
         WAITVBL;WAITVBL;WAITVBL;
     }
@@ -354,16 +491,20 @@ const u32 crc32_table[256] = {
 // --------------------------------------------------
 // Compute the CRC of a memory buffer of any size...
 // --------------------------------------------------
-u32 getCRC32(u8 *buf, int size)
+// Running CRC32 - start with 0xFFFFFFFF and invert the result once all is in
+u32 updateCRC32(u32 crc, u8 *buf, int size)
 {
-    u32 crc = 0xFFFFFFFF;
-
     for (int i=0; i < size; i++)
     {
         crc = (crc >> 8) ^ crc32_table[(crc & 0xFF) ^ (u8)buf[i]];
     }
 
-    return ~crc;
+    return crc;
+}
+
+u32 getCRC32(u8 *buf, int size)
+{
+    return ~updateCRC32(0xFFFFFFFF, buf, size);
 }
 
 struct Config_t AllConfigs[MAX_CONFIGS];
@@ -379,12 +520,12 @@ void SetDefaultGlobalConfig(void)
     myGlobalConfig.defaultPoundKey  = 1;
     myGlobalConfig.defaultJoyPort   = 1;
     myGlobalConfig.keyboardDim      = 0;
-    myGlobalConfig.reserved0        = 0;
-    myGlobalConfig.reserved1        = 0;
-    myGlobalConfig.reserved2        = 0;
+    myGlobalConfig.sidQuality       = (isDSiMode() ? 1:0); // Oversampled SID on the DSi, cheaper output on the older DS
+    myGlobalConfig.sidEngine        = 0;                   // SID voices rendered here on the ARM9
+    myGlobalConfig.autoWarp         = 0;                   // Run at normal speed even while loading
     myGlobalConfig.reserved3        = 0;
-    myGlobalConfig.reserved4        = 0;
-    myGlobalConfig.reserved5        = 0;
+    myGlobalConfig.runAhead         = 0;                   // Show the frames as they are emulated
+    myGlobalConfig.stateHash        = 0;                   // No per-frame state hashing (a debugging aid)
     myGlobalConfig.reserved6        = 0;
     myGlobalConfig.reserved7        = 0;
     myGlobalConfig.reserved8        = 0;
@@ -420,7 +561,7 @@ void SetDefaultGameConfig(void)
     myConfig.cpuCycles   = 0;                // Normal 63 - this is the delta adjustment to that
     myConfig.ciaCycles   = 0;                // Normal 63 - this is the delta adjustment to that
     myConfig.flopCycles  = 0;                // Normal 64 - this is the delta adjustment to that
-    myConfig.reserved2   = 0;
+    myConfig.sid2Addr    = SID2_NONE;        // Single SID by default
     myConfig.reserved3   = 0;
     myConfig.reserved4   = 0;
     myConfig.reserved5   = 1;               // In case we need a default at '1' = ON/Enabled
@@ -530,12 +671,18 @@ void SaveConfig(bool bShow)
 
         // --------------------------------------------------------------------
         // Compress the configuration data - this shrinks down quite nicely...
+        // It goes straight to the file and the length is filled in after.
         // --------------------------------------------------------------------
-        int max_len = lzav_compress_bound_hi( sizeof(AllConfigs) );
-        int comp_len = lzav_compress_hi( &AllConfigs, CompressBuffer, sizeof(AllConfigs), max_len );
-
+        u32 comp_len = 0;
+        long len_pos = ftell(fp);
         fwrite(&comp_len,          sizeof(comp_len), 1, fp);
-        fwrite(CompressBuffer,     comp_len,         1, fp);
+        int stored_len = lzav_stream_write(fp, &AllConfigs, sizeof(AllConfigs), true, NULL);
+        if (stored_len > 0)
+        {
+            comp_len = stored_len | CONFIG_STREAMED;
+            fseek(fp, len_pos, SEEK_SET);
+            fwrite(&comp_len,      sizeof(comp_len), 1, fp);
+        }
 
         fclose(fp);
     } else DSPrint(4,3,0, (char*)"ERROR SAVING CONFIG FILE");
@@ -546,6 +693,23 @@ void SaveConfig(bool bShow)
         DSPrint(4,3,0, (char*)"                        ");
     }
 }
+// ----------------------------------------------------------
+// Decompress the AllConfigs[] windows from GimliDS.DAT and
+// return the CRC of what was read (so two reads can agree).
+// ----------------------------------------------------------
+static u32 ReadConfigStream(u32 offset, u32 stored_len)
+{
+    u32 crc = 0xFFFFFFFF;
+    FILE* file = fopen("/data/GimliDS.DAT", "rb");
+    if (file)
+    {
+        fseek(file, offset, SEEK_SET);
+        (void)lzav_stream_read(file, AllConfigs, sizeof(AllConfigs), stored_len, &crc);
+        fclose(file);
+    }
+    return crc;
+}
+
 // ----------------------------------------------------------
 // Load configuration into memory where we can use it.
 // The configuration is stored in GimliDS.DAT
@@ -571,9 +735,23 @@ void LoadConfig(void)
         else // Read in the compressed buffer... we will uncompress this back into the AllConfigs[] array...
         {
             u32 comp_len = 0;
+            u32 offset = sizeof(ver) + sizeof(myGlobalConfig) + sizeof(comp_len);
             ReadFileCarefully((char *)"/data/GimliDS.DAT", (u8*)&comp_len, sizeof(comp_len), sizeof(ver) + sizeof(myGlobalConfig));
-            ReadFileCarefully((char *)"/data/GimliDS.DAT", (u8*)CompressBuffer, comp_len, sizeof(ver) + sizeof(myGlobalConfig)+ sizeof(comp_len));
-            (void)lzav_decompress( CompressBuffer, AllConfigs, comp_len, sizeof(AllConfigs) );
+            if (comp_len & CONFIG_STREAMED)
+            {
+                // Same care as ReadFileCarefully() - read it until two reads agree
+                while (ReadConfigStream(offset, comp_len & ~CONFIG_STREAMED) != ReadConfigStream(offset, comp_len & ~CONFIG_STREAMED));
+            }
+            else // Older file compressed in one piece
+            {
+                u8 *comp_buf = (u8*)malloc(comp_len);
+                if (comp_buf)
+                {
+                    ReadFileCarefully((char *)"/data/GimliDS.DAT", comp_buf, comp_len, offset);
+                    (void)lzav_decompress( comp_buf, AllConfigs, comp_len, sizeof(AllConfigs) );
+                    free(comp_buf);
+                }
+            }
         }
     }
     else    // Not found... init the entire database...
@@ -691,7 +869,7 @@ void FindConfig(void)
 struct options_t
 {
     const char  *label;
-    const char  *option[72];
+    const char  *option[74];
     u8          *option_val;
     u8           option_max;
 };
@@ -706,7 +884,8 @@ struct options_t
                         "KEY M", "KEY N", "KEY O", "KEY P", "KEY Q", "KEY R", "KEY S", "KEY T", "KEY U", "KEY V", "KEY W", "KEY X",\
                         "KEY Y", "KEY Z", "KEY 1", "KEY 2", "KEY 3", "KEY 4", "KEY 5", "KEY 6", "KEY 7", "KEY 8", "KEY 9", "KEY 0",\
                         "PAN-UP 16", "PAN-UP 24", "PAN-UP 32", "PAN-DOWN 16", "PAN-DOWN 24", "PAN-DOWN 32","PAN-LEFT 32", "PAN-RIGHT 32",\
-                        "PAN-LEFT 64", "PAN-RIGHT 64", "ZOOM TOGGLE"
+                        "PAN-LEFT 64", "PAN-RIGHT 64", "ZOOM TOGGLE", "REWIND",\
+                        "QUICK SAVE", "QUICK LOAD"
 
 
 const struct options_t Option_Table[2][20] =
@@ -715,6 +894,7 @@ const struct options_t Option_Table[2][20] =
     {
         {"TRUE DRIVE",     {"DISABLE (FAST)", "ENABLED (SLOW)"},                                        &myConfig.trueDrive,   2},
         {"REU TYPE",       {"NONE", "REU-1764 256K"},                                                   &myConfig.reuType,     2},
+        {"SECOND SID",     {"NONE", "AT $D420", "AT $D500", "AT $DE00"},                                &myConfig.sid2Addr,    4},
         {"JOY PORT",       {"PORT 1", "PORT 2"},                                                        &myConfig.joyPort,     2},
         {"JOY MODE",       {"NORMAL", "SLIDE-N-GLIDE", "DIAGONALS"},                                    &myConfig.joyMode,     3},
         {"LCD JITTER",     {"NONE", "LIGHT", "HEAVY"},                                                  &myConfig.jitter,      3},
@@ -724,15 +904,15 @@ const struct options_t Option_Table[2][20] =
         {"FLOP CYCLES",    {CPU_CYCLE_DELTA_STR},                                                       &myConfig.flopCycles,  10},
         {"POUND KEY",      {"POUND", "BACK ARROW", "UP ARROW", "C= COMMODORE"},                         &myConfig.poundKey,    4},
 
-        {"D-PAD UP",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[0],  71},
-        {"D-PAD DOWN",     {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[1],  71},
-        {"D-PAD LEFT",     {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[2],  71},
-        {"D-PAD RIGHT",    {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[3],  71},
+        {"D-PAD UP",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[0],  74},
+        {"D-PAD DOWN",     {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[1],  74},
+        {"D-PAD LEFT",     {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[2],  74},
+        {"D-PAD RIGHT",    {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[3],  74},
 
-        {"A BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[4],  71},
-        {"B BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[5],  71},
-        {"X BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[6],  71},
-        {"Y BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[7],  71},
+        {"A BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[4],  74},
+        {"B BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[5],  74},
+        {"X BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[6],  74},
+        {"Y BUTTON",       {KEY_MAP_OPTIONS},                                                           &myConfig.key_map[7],  74},
 
         {NULL,             {"",      ""},                                                               NULL,                  1}
     },
@@ -742,9 +922,14 @@ const struct options_t Option_Table[2][20] =
         {"DEF DSK/FLSH",       {"READ NO SFX", "READ WITH SFX", "WRITE NO SFX", "WRITE WITH SFX"},      &myGlobalConfig.defaultDiskFlash,   4},
         {"DEF PND KEY",        {"POUND", "BACK ARROW", "UP ARROW", "C= COMMODORE"},                     &myGlobalConfig.defaultPoundKey,    4},
         {"DEF KEYBOARD",       {"MAX BRIGHT", "DIM", "DIMMER", "DIMMEST"},                              &myGlobalConfig.keyboardDim,        4},
-        {"DEF KEY B",          {KEY_MAP_OPTIONS},                                                       &myGlobalConfig.defaultB,           71},
-        {"DEF KEY X",          {KEY_MAP_OPTIONS},                                                       &myGlobalConfig.defaultX,           71},
-        {"DEF KEY Y",          {KEY_MAP_OPTIONS},                                                       &myGlobalConfig.defaultY,           71},
+        {"SID QUALITY",        {"NORMAL (FAST)", "OVERSAMPLED"},                                        &myGlobalConfig.sidQuality,         2},
+        {"SID ENGINE",         {"ARM9 (NORMAL)", "ARM7 (OFFLOAD)"},                                     &myGlobalConfig.sidEngine,          2},
+        {"AUTO WARP",          {"OFF", "ON (UNTIL MUSIC)", "ON (MUTED)"},                               &myGlobalConfig.autoWarp,           3},
+        {"RUN-AHEAD",          {"OFF", "1 FRAME (DSI)", "2 FRAMES (DSI)"},                              &myGlobalConfig.runAhead,           3},
+        {"STATE HASH",         {"OFF", "ON (DEBUG)"},                                                   &myGlobalConfig.stateHash,          2},
+        {"DEF KEY B",          {KEY_MAP_OPTIONS},                                                       &myGlobalConfig.defaultB,           74},
+        {"DEF KEY X",          {KEY_MAP_OPTIONS},                                                       &myGlobalConfig.defaultX,           74},
+        {"DEF KEY Y",          {KEY_MAP_OPTIONS},                                                       &myGlobalConfig.defaultY,           74},
 
         {NULL,                 {"",      ""},                                                           NULL,                               1}
     }
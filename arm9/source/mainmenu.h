@@ -18,7 +18,7 @@ struct __attribute__((__packed__)) Config_t
     u8  cpuCycles;
     u8  ciaCycles;
     u8  flopCycles;
-    u8  reserved2;
+    u8  sid2Addr;
     u8  reserved3;
     u8  reserved4;
     u8  reserved5;
@@ -37,12 +37,12 @@ struct __attribute__((__packed__)) GlobalConfig_t
     u8  defaultJoyPort;
     u8  defaultPoundKey;
     u8  keyboardDim;
-    u8  reserved0;
-    u8  reserved1;
-    u8  reserved2;
+    u8  sidQuality;
+    u8  sidEngine;
+    u8  autoWarp;
     u8  reserved3;
-    u8  reserved4;
-    u8  reserved5;
+    u8  runAhead;
+    u8  stateHash;
     u8  reserved6;
     u8  reserved7;
     u8  reserved8;
@@ -132,8 +132,11 @@ extern struct GlobalConfig_t  myGlobalConfig;
 #define KEY_MAP_PAN_RT64   69
 
 #define KEY_MAP_ZOOM_SCR   70
+#define KEY_MAP_REWIND     71
+#define KEY_MAP_QUICK_SAVE 72
+#define KEY_MAP_QUICK_LOAD 73
 
-#define KEY_MAP_MAX        71
+#define KEY_MAP_MAX        74
 
 #define JOYMODE_NORMAL          0
 #define JOYMODE_SLIDE_N_GLIDE   1
@@ -145,6 +148,7 @@ extern struct GlobalConfig_t  myGlobalConfig;
 #define DISK_WRITE_WITH_SFX     0x03
 
 extern u32 getCRC32(u8 *buf, int size);
+extern u32 updateCRC32(u32 crc, u8 *buf, int size);
 extern u32 file_crc;
 void LoadConfig(void);
 void LoadFavorites(void);
@@ -0,0 +1,84 @@
+// =====================================================================================
+// GimliDS Copyright (c) 2025-2026 Dave Bernazzani (wavemotion-dave)
+//
+// As GimliDS is a port of the Frodo emulator for the DS/DSi/XL/LL handhelds,
+// any copying or distribution of this emulator, its source code and associated
+// readme files, with or without modification, are permitted per the original
+// Frodo emulator license shown below.  Hugest thanks to Christian Bauer for his
+// efforts to provide a clean open-source emulation base for the C64.
+//
+// Numerous hacks and 'unsafe' optimizations have been performed on the original
+// Frodo emulator codebase to get it running on the small handheld system. You
+// are strongly encouraged to seek out the official Frodo sources if you're at
+// all interested in this emulator code.
+//
+// The GimliDS emulator is offered as-is, without any warranty. Please see readme.md
+// =====================================================================================
+
+/*
+ *  SIDFifo.h - Message format for running the SID voices on the ARM7
+ *
+ *  Shared by both cores. When the SID is offloaded, the ARM9 only sends the
+ *  register writes (stamped with the raster line they happened on) and a
+ *  frame marker at the top of every frame. The ARM7 replays the writes at
+ *  the matching point of its own output and drives a hardware sound channel.
+ */
+
+#ifndef _SID_FIFO_H
+#define _SID_FIFO_H
+
+#define FIFO_SID7               FIFO_USER_01
+
+#define SID7_CHANNEL            15          // Hardware sound channel locked away from maxmod
+#define SID7_SAMPLE_FREQ        19500       // The ARM7 has a quarter of the DSi ARM9 clock - stay at the DS-Lite rate
+#define SID7_LINES_PER_FRAME    312         // PAL rasters
+#define SID7_FRAMES_PER_SEC     50
+
+// ----------------------------------------------------------------------------------
+// Register write:  line (9 bits) | register (6 bits) | data (8 bits) - fits in a
+//                  single FIFO word as this is by far the most common message
+// Coefficient:     01 | line (9 bits) | coefficient (3 bits) | data (16 bits)
+// Command:         1 | command (7 bits) | argument (24 bits)
+// ----------------------------------------------------------------------------------
+#define SID7_MSG_CMD            0x80000000
+#define SID7_MSG_COEF           0x40000000
+#define SID7_MSG_REG(line, reg, data)   ((((line) & 0x1FF) << 14) | (((reg) & 0x3F) << 8) | ((data) & 0xFF))
+#define SID7_MSG_COEFF(line, idx, data) (SID7_MSG_COEF | (((line) & 0x1FF) << 19) | (((idx) & 0x7) << 16) | ((data) & 0xFFFF))
+#define SID7_MSG_COMMAND(cmd, arg)      (SID7_MSG_CMD | (((cmd) & 0x7F) << 24) | ((arg) & 0xFFFFFF))
+
+#define SID7_MSG_LINE(msg)      (((msg) & SID7_MSG_COEF) ? (((msg) >> 19) & 0x1FF) : (((msg) >> 14) & 0x1FF))
+#define SID7_MSG_REGNUM(msg)    (((msg) & SID7_MSG_COEF) ? (SID7_REG_AMPL_LO + (((msg) >> 16) & 0x7)) : (((msg) >> 8) & 0x3F))
+#define SID7_MSG_DATA(msg)      (((msg) & SID7_MSG_COEF) ? ((msg) & 0xFFFF) : ((msg) & 0xFF))
+#define SID7_MSG_CMDNUM(msg)    (((msg) >> 24) & 0x7F)
+#define SID7_MSG_ARG(msg)       ((msg) & 0xFFFFFF)
+
+// Commands
+#define SID7_CMD_START          1           // Start the output channel - argument unused
+#define SID7_CMD_STOP           2           // Stop the output channel
+#define SID7_CMD_RESET          3           // Reset voices and filter
+#define SID7_CMD_PAUSE          4           // Hold the last sample (menus, disk access)
+#define SID7_CMD_RESUME         5
+#define SID7_CMD_FRAME          6           // Top of frame - argument is the 16-bit frame counter
+
+// Registers 0..24 are the SID registers. The filter coefficients are computed on the
+// ARM9 from its precomputed tables and passed along as coefficient messages which the
+// ARM7 treats as extra registers from SID7_REG_AMPL_LO on.
+#define SID7_COEF_AMPL_LO       0           // Filter amplification 16.16 - low half (latched)
+#define SID7_COEF_AMPL_HI       1           // Filter amplification 16.16 - high half (applies both)
+#define SID7_COEF_D1            2           // 3.13 fixed
+#define SID7_COEF_D2            3           // 3.13 fixed
+#define SID7_COEF_G1            4           // 2.14 fixed
+#define SID7_COEF_G2            5           // 2.14 fixed
+
+#define SID7_REG_AMPL_LO        (0x20 + SID7_COEF_AMPL_LO)
+#define SID7_REG_AMPL_HI        (0x20 + SID7_COEF_AMPL_HI)
+#define SID7_REG_D1             (0x20 + SID7_COEF_D1)
+#define SID7_REG_D2             (0x20 + SID7_COEF_D2)
+#define SID7_REG_G1             (0x20 + SID7_COEF_G1)
+#define SID7_REG_G2             (0x20 + SID7_COEF_G2)
+
+// Before SID7_CMD_START the ARM9 sends (fifoSendAddress) a main RAM copy of its
+// combined waveform tables: TriSaw, TriRect, SawRect, TriSawRect - 256 entries each.
+#define SID7_WAVE_TABLE_SIZE    (4*256)
+
+#endif